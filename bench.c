@@ -0,0 +1,671 @@
+/*
+Micro-benchmarks of the decoding hot path.
+
+The decoder is compiled right into this file, so static functions of telxcc.c can be measured one by one.
+Input is a synthetic mux generated at start-up (deterministic, no files needed); recorded TS files given
+by -f or on the command line are benchmarked as a whole in addition. With -u every TS benchmark is run
+once more without the PID pre-filter, every packet going through the full header decode as before it.
+
+usage: teletext-bench [-u] [-r repetitions] [-t ms per repetition] [-p page] [-f file.ts] [file.ts ...]
+*/
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <err.h>
+#include "telxcc.c"
+
+// default number of measured repetitions of every benchmark
+#define BENCH_REPETITIONS 15
+
+// default minimal duration of one repetition (in ms)
+#define BENCH_REPETITION_MS 20
+
+// synthetic mux: 25 frames per second, every frame is carried in this many packets per PID
+#define SYNTH_VIDEO_PER_FRAME 100
+#define SYNTH_AUDIO_PER_FRAME 10
+#define SYNTH_TELETEXT_PER_FRAME 1
+
+// multiple of 16, so that the continuity counters continue seamlessly when the mux is looped
+#define SYNTH_FRAMES 400
+
+#define SYNTH_PCR_PID 0x100
+#define SYNTH_AUDIO_PID 0x101
+#define SYNTH_TELETEXT_PID 0x200
+#define SYNTH_PAGE 0x888
+
+typedef struct {
+    const char *name;
+    const char *unit;
+    void (*run)(void *arg, uint64_t iterations);
+    void *arg;
+    uint64_t ops_per_iteration;
+} benchmark_t;
+
+static unsigned int repetitions = BENCH_REPETITIONS;
+static unsigned int repetition_ms = BENCH_REPETITION_MS;
+static uint8_t unfiltered = NO;
+
+// keeps results alive, so that the compiler cannot drop measured work
+static volatile uint64_t sink;
+
+static void output_sink(void *opaque, const char *data, size_t length) {
+    sink += length;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// runs benchmark repetitions times after a calibration run, prints median, minimum and spread
+// (median absolute deviation relative to median)
+static void measure(const benchmark_t *b) {
+    // calibration doubles as warm-up: iterations are doubled until a repetition takes repetition_ms
+    uint64_t iterations = 1;
+    while (1) {
+        uint64_t t0 = now_ns();
+        b->run(b->arg, iterations);
+        if (now_ns() - t0 >= repetition_ms * 1000000ULL) break;
+        iterations *= 2;
+    }
+
+    double samples[repetitions], deviations[repetitions];
+    for (unsigned int r = 0; r < repetitions; r++) {
+        uint64_t t0 = now_ns();
+        b->run(b->arg, iterations);
+        samples[r] = (double) (now_ns() - t0) / (iterations * b->ops_per_iteration);
+    }
+    qsort(samples, repetitions, sizeof(double), compare_double);
+    double median = samples[repetitions / 2];
+    for (unsigned int r = 0; r < repetitions; r++) deviations[r] = fabs(samples[r] - median);
+    qsort(deviations, repetitions, sizeof(double), compare_double);
+    double spread = 100.0 * deviations[repetitions / 2] / median;
+
+    printf("%-24s %10.2f ns/%-8s %10.3f M%s/s %10.2f ns min  +-%.1f%%\n",
+        b->name, median, b->unit, 1000.0 / median, b->unit, samples[0], spread);
+}
+
+// bit loop Hamming 24/18 decoder the table driven unham_24_18() has to match
+static uint32_t unham_24_18_reference(uint32_t a) {
+    uint8_t test = 0;
+
+    for (uint8_t i = 0; i < 23; i++) test ^= ((a >> i) & 0x01) * (i + 33);
+    test ^= ((a >> 23) & 0x01) * 32;
+
+    if ((test & 0x1f) != 0x1f) {
+        if ((test & 0x20) == 0x20) return 0xffffffff;
+        a ^= 1 << (30 - test);
+    }
+
+    return (a & 0x000004) >> 2 | (a & 0x000070) >> 3 | (a & 0x007f00) >> 4 | (a & 0x7f0000) >> 5;
+}
+
+/* synthetic data */
+
+// error free Hamming 8/4 codewords, derived from the decoding table: the codeword is the one
+// byte of every nibble whose single bit errors all decode to the same nibble
+static uint8_t HAM_8_4[16];
+
+static void init_ham_8_4(void) {
+    for (uint16_t a = 0; a < 256; a++) {
+        uint8_t d = UNHAM_8_4[a];
+        if (d == 0xff) continue;
+
+        uint8_t center = YES;
+        for (uint8_t i = 0; i < 8; i++) if (UNHAM_8_4[a ^ (1 << i)] != d) center = NO;
+        if (center == YES) HAM_8_4[d & 0x0f] = a;
+    }
+}
+
+// Hamming 24/18 (ETS 300 706, chapter 8.3): data at positions 3, 5-7, 9-15, 17-23; positions 1, 2, 4, 8, 16
+// make the tests A-E pass (XOR of positions of set bits is 31), position 24 makes the overall parity odd
+static uint32_t ham_24_18(uint32_t d) {
+    uint32_t a = ((d & 0x1) << 2) | ((d & 0xe) << 3) | ((d & 0x7f0) << 4) | ((d & 0x3f800) << 5);
+
+    uint8_t x = 0;
+    for (uint8_t i = 0; i < 23; i++) if ((a >> i) & 0x01) x ^= i + 1;
+    x ^= 0x1f;
+    for (uint8_t k = 0; k < 5; k++) if ((x >> k) & 0x01) a |= 1 << ((1 << k) - 1);
+
+    if ((__builtin_popcount(a) & 0x01) == 0) a |= 1 << 23;
+    return a;
+}
+
+// odd parity character
+static uint8_t parity(uint8_t c) {
+    c &= 0x7f;
+    return (PARITY_8[c] == 1) ? c : (c | 0x80);
+}
+
+// 44 bytes teletext data unit payload, bit reversed as transmitted
+static void telx_packet(uint8_t *p, uint8_t m, uint8_t y, const uint8_t data[40]) {
+    p[0] = 0x55;
+    p[1] = 0x27;
+    p[2] = HAM_8_4[(m & 0x7) | ((y & 0x1) << 3)];
+    p[3] = HAM_8_4[y >> 1];
+    memcpy(&p[4], data, 40);
+    for (uint8_t i = 0; i < 44; i++) p[i] = REVERSE_8[p[i]];
+}
+
+static void page_header(uint8_t *p, uint16_t page) {
+    uint8_t data[40];
+    memset(data, HAM_8_4[0], 40);
+    data[0] = HAM_8_4[page & 0x0f];
+    data[1] = HAM_8_4[(page >> 4) & 0x0f];
+    data[3] = HAM_8_4[0x08]; // C4 erase page
+    data[5] = HAM_8_4[0x08]; // C6 subtitle
+    data[7] = HAM_8_4[0x01]; // C11 serial mode, C12-C14 national subset 0
+    for (uint8_t i = 8; i < 40; i++) data[i] = parity(' ');
+    telx_packet(p, page >> 8, 0, data);
+}
+
+// boxed, partly coloured subtitle row
+static void page_row(uint8_t *p, uint16_t page, uint8_t y, const char *text, uint8_t colour) {
+    uint8_t data[40];
+    for (uint8_t i = 0; i < 40; i++) data[i] = parity(' ');
+    data[1] = parity(colour);
+    data[2] = parity(0x0b);
+    data[3] = parity(0x0b);
+    for (uint8_t i = 0; (text[i] != '\0') && (i < 34); i++) data[4 + i] = parity(text[i]);
+    data[39] = parity(0x0a);
+    telx_packet(p, page >> 8, y, data);
+}
+
+// one TS packet long PES packet: PES header padded to 46 bytes, then 3 teletext data units
+static void teletext_pes(uint8_t *payload, uint64_t pts, const uint8_t units[3][44], uint8_t unit_count) {
+    memset(payload, 0xff, 184);
+    payload[0] = 0x00;
+    payload[1] = 0x00;
+    payload[2] = 0x01;
+    payload[3] = 0xbd;
+    payload[4] = (184 - 6) >> 8;
+    payload[5] = (184 - 6) & 0xff;
+    payload[6] = 0x84; // data alignment
+    payload[7] = 0x80; // PTS only
+    payload[8] = 36; // PES header data length: PTS + stuffing
+    payload[9] = 0x21 | ((pts >> 29) & 0x0e);
+    payload[10] = pts >> 22;
+    payload[11] = 0x01 | ((pts >> 14) & 0xfe);
+    payload[12] = pts >> 7;
+    payload[13] = 0x01 | ((pts << 1) & 0xfe);
+    payload[45] = 0x10; // data_identifier: EBU data
+
+    for (uint8_t i = 0; i < 3; i++) {
+        uint8_t *unit = &payload[46 + i * 46];
+        if (i < unit_count) {
+            unit[0] = DATA_UNIT_EBU_TELETEXT_SUBTITLE;
+            unit[1] = 44;
+            memcpy(&unit[2], units[i], 44);
+        } else {
+            unit[0] = 0xff; // stuffing
+            unit[1] = 44;
+        }
+    }
+}
+
+static void ts_header(uint8_t *p, uint16_t pid, uint8_t pusi, uint8_t *cc) {
+    p[0] = 0x47;
+    p[1] = (pusi ? 0x40 : 0x00) | (pid >> 8);
+    p[2] = pid & 0xff;
+    p[3] = 0x10 | (*cc & 0x0f);
+    (*cc)++;
+}
+
+typedef struct {
+    uint8_t *packets;
+    size_t count;
+} ts_buffer_t;
+
+// teletext PES of frame f: every 25th frame carries a new page (header and two rows), others are stuffing
+static void teletext_frame(uint8_t *payload, unsigned int f) {
+    uint8_t units[3][44];
+    uint8_t count = 0;
+    if (f % 25 == 0) {
+        char line[40];
+        snprintf(line, sizeof(line), "Synthetic subtitle %u <&>", f / 25);
+        page_header(units[0], SYNTH_PAGE);
+        page_row(units[1], SYNTH_PAGE, 20, line, 0x07);
+        page_row(units[2], SYNTH_PAGE, 22, "Second line in yellow", 0x03);
+        count = 3;
+    }
+    teletext_pes(payload, (uint64_t) f * 3600, (const uint8_t (*)[44]) units, count);
+}
+
+// full mux: video with PCR, audio and teletext, about 99 % of packets are not teletext
+static ts_buffer_t synth_mux(void) {
+    size_t per_frame = SYNTH_VIDEO_PER_FRAME + SYNTH_AUDIO_PER_FRAME + SYNTH_TELETEXT_PER_FRAME;
+    ts_buffer_t b = { .count = SYNTH_FRAMES * per_frame };
+    b.packets = calloc(b.count, TS_SIZE);
+    if (b.packets == NULL)
+        err(1, "calloc");
+
+    uint8_t cc_video = 0, cc_audio = 0, cc_teletext = 0;
+    uint8_t *p = b.packets;
+    for (unsigned int f = 0; f < SYNTH_FRAMES; f++) {
+        for (unsigned int i = 0; i < SYNTH_VIDEO_PER_FRAME; i++, p += TS_SIZE) {
+            ts_header(p, SYNTH_PCR_PID, i == 0, &cc_video);
+            if (i == 0) {
+                // adaptation field with PCR, 40 ms per frame
+                ts_set_adaptation(p, 7);
+                tsaf_set_pcr(p, (uint64_t) f * 3600);
+                memset(&p[12], f & 0xff, TS_SIZE - 12);
+            } else {
+                memset(&p[4], f & 0xff, TS_SIZE - 4);
+            }
+        }
+        for (unsigned int i = 0; i < SYNTH_AUDIO_PER_FRAME; i++, p += TS_SIZE) {
+            ts_header(p, SYNTH_AUDIO_PID, i == 0, &cc_audio);
+            memset(&p[4], i, TS_SIZE - 4);
+        }
+        ts_header(p, SYNTH_TELETEXT_PID, YES, &cc_teletext);
+        teletext_frame(&p[4], f);
+        p += TS_SIZE;
+    }
+    return b;
+}
+
+// teletext PID only, every packet carries a page
+static ts_buffer_t synth_teletext(void) {
+    ts_buffer_t b = { .count = SYNTH_FRAMES };
+    b.packets = calloc(b.count, TS_SIZE);
+    if (b.packets == NULL)
+        err(1, "calloc");
+
+    uint8_t cc = 0;
+    for (unsigned int f = 0; f < SYNTH_FRAMES; f++) {
+        uint8_t *p = b.packets + f * TS_SIZE;
+        ts_header(p, SYNTH_TELETEXT_PID, YES, &cc);
+        teletext_frame(&p[4], f * 25);
+    }
+    return b;
+}
+
+static ts_buffer_t load_file(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        err(1, "%s", path);
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        err(1, "%s", path);
+
+    ts_buffer_t b = { .count = st.st_size / TS_SIZE };
+    b.packets = malloc(b.count * TS_SIZE);
+    if (b.packets == NULL)
+        err(1, "malloc");
+    if (read(fd, b.packets, b.count * TS_SIZE) != (ssize_t) (b.count * TS_SIZE))
+        err(1, "%s: read", path);
+    close(fd);
+
+    if ((b.count == 0) || !ts_validate(b.packets))
+        errx(1, "%s: TS file with 188 bytes packets expected", path);
+    return b;
+}
+
+/* benchmarks */
+
+typedef struct {
+    telx_decoder_t *dec;
+    ts_buffer_t ts;
+} ts_arg_t;
+
+static void run_ts(void *arg, uint64_t iterations) {
+    ts_arg_t *a = arg;
+    for (uint64_t i = 0; i < iterations; i++)
+        telx_feed_ts_burst(a->dec, a->ts.packets, a->ts.count);
+}
+
+// baseline: no PID pre-filter, full header decode and PCR check of every packet
+static void run_ts_unfiltered(void *arg, uint64_t iterations) {
+    ts_arg_t *a = arg;
+    for (uint64_t i = 0; i < iterations; i++)
+        for (size_t j = 0; j < a->ts.count; j++) process_ts_packet(a->dec, a->ts.packets + j * TS_SIZE);
+}
+
+// packets per second with the pre-filter, and with -u without it
+static void measure_ts(const char *name, ts_arg_t *a) {
+    measure(&(benchmark_t) { name, "packet", run_ts, a, a->ts.count });
+    if (unfiltered == YES) {
+        char baseline[80];
+        snprintf(baseline, sizeof(baseline), "%s/unfiltered", name);
+        measure(&(benchmark_t) { baseline, "packet", run_ts_unfiltered, a, a->ts.count });
+    }
+}
+
+typedef struct {
+    telx_decoder_t *dec;
+    pid_stream_t *stream;
+    uint8_t pes[184];
+} pes_arg_t;
+
+// every iteration is a new PES packet, parsed straight from the payload
+static void run_pes(void *arg, uint64_t iterations) {
+    pes_arg_t *a = arg;
+    for (uint64_t i = 0; i < iterations; i++)
+        process_pes_payload(a->dec, a->stream, a->pes, sizeof(a->pes), 1);
+}
+
+typedef struct {
+    uint8_t bytes[4096];
+    uint32_t words[4096];
+} codes_arg_t;
+
+static void run_unham_8_4(void *arg, uint64_t iterations) {
+    codes_arg_t *a = arg;
+    uint64_t s = 0;
+    for (uint64_t i = 0; i < iterations; i++)
+        for (uint16_t j = 0; j < 4096; j++) s += unham_8_4(a->bytes[j]);
+    sink += s;
+}
+
+static void run_unham_24_18(void *arg, uint64_t iterations) {
+    codes_arg_t *a = arg;
+    uint64_t s = 0;
+    for (uint64_t i = 0; i < iterations; i++)
+        for (uint16_t j = 0; j < 4096; j++) s += unham_24_18(a->words[j]);
+    sink += s;
+}
+
+static void run_unham_24_18_reference(void *arg, uint64_t iterations) {
+    codes_arg_t *a = arg;
+    uint64_t s = 0;
+    for (uint64_t i = 0; i < iterations; i++)
+        for (uint16_t j = 0; j < 4096; j++) s += unham_24_18_reference(a->words[j]);
+    sink += s;
+}
+
+typedef struct {
+    const kernels_t *kernels;
+    uint8_t units[64][44];
+    uint16_t rows[64][40];
+} kernel_arg_t;
+
+// random row characters: controls, boxes, spaces, letters and UCS-2 above 0x7fff
+static uint16_t random_cell(void) {
+    static const uint16_t CELLS[] = { 0x00, 0x03, 0x0a, 0x0b, 0x20, 0x21, 'a', 0x00e4, 0x7fff, 0x8000, 0xffff };
+    return CELLS[rand() % ARRAY_LENGTH(CELLS)];
+}
+
+static void run_reverse_unit(void *arg, uint64_t iterations) {
+    kernel_arg_t *a = arg;
+    for (uint64_t i = 0; i < iterations; i++)
+        for (uint8_t j = 0; j < 64; j++) a->kernels->reverse_unit(a->units[j]);
+    sink += a->units[0][0];
+}
+
+static void run_row_bitmaps(void *arg, uint64_t iterations) {
+    kernel_arg_t *a = arg;
+    uint64_t printable, start_box, end_box, s = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        for (uint8_t j = 0; j < 64; j++) {
+            a->kernels->row_bitmaps(a->rows[j], &printable, &start_box, &end_box);
+            s += printable ^ start_box ^ end_box;
+        }
+    }
+    sink += s;
+}
+
+// row of random characters decoded into a row not written since the page header
+static void run_decode_row(void *arg, uint64_t iterations) {
+    kernel_arg_t *a = arg;
+    static teletext_page_t page;
+    uint64_t s = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        for (uint8_t j = 0; j < 64; j++) {
+            page.rows = 0;
+            s += decode_row(&page, 20, &a->units[j][4], REVERSE_PARITY_G0_LATIN[0]) + page.text[20][j % 40];
+        }
+    }
+    sink += s;
+}
+
+// every kernel against REVERSE_8, every byte value at every position
+static void verify_kernels(void) {
+    for (unsigned int k = 0; k < KERNEL_COUNT; k++) {
+        for (uint16_t r = 0; r < 256; r++) {
+            uint8_t unit[44];
+            for (uint8_t j = 0; j < 44; j++) unit[j] = r + j;
+
+            KERNELS[k]->reverse_unit(unit);
+            for (uint8_t j = 0; j < 44; j++) {
+                if (unit[j] != REVERSE_8[(uint8_t) (r + j)])
+                    errx(1, "%s reverse_unit() mismatch at %u (%02x)", KERNELS[k]->name, j, (uint8_t) (r + j));
+            }
+        }
+
+        for (uint16_t r = 0; r < 4096; r++) {
+            uint16_t row[40];
+            uint64_t bitmaps[3], expected[3] = { 0, 0, 0 };
+            for (uint8_t j = 0; j < 40; j++) {
+                row[j] = random_cell();
+                if (row[j] > 0x20) expected[0] |= 1ULL << j;
+                if (row[j] == 0x0b) expected[1] |= 1ULL << j;
+                if (row[j] == 0x0a) expected[2] |= 1ULL << j;
+            }
+
+            KERNELS[k]->row_bitmaps(row, &bitmaps[0], &bitmaps[1], &bitmaps[2]);
+            if (memcmp(bitmaps, expected, sizeof(bitmaps)) != 0)
+                errx(1, "%s row_bitmaps() mismatch", KERNELS[k]->name);
+        }
+    }
+}
+
+static void run_telx_to_ucs2(void *arg, uint64_t iterations) {
+    codes_arg_t *a = arg;
+    uint64_t s = 0;
+    for (uint64_t i = 0; i < iterations; i++)
+        for (uint16_t j = 0; j < 4096; j++) s += telx_to_ucs2(G0_LATIN_SUBSETS[0], a->bytes[j]);
+    sink += s;
+}
+
+typedef struct {
+    telx_decoder_t *dec;
+    page_decoder_t *decoder;
+    // one character of the last row alternates, so every page differs from the previous one
+    uint8_t changing;
+} page_arg_t;
+
+static void run_process_page(void *arg, uint64_t iterations) {
+    page_arg_t *a = arg;
+    uint16_t *c = &a->decoder->page_buffer.text[22][5];
+    for (uint64_t i = 0; i < iterations; i++) {
+        if (a->changing == YES) *c ^= 0x20;
+        process_page(a->dec, a->decoder);
+    }
+}
+
+// whole service in the store: 1024 pages of 4 subpages, every update changes one of them
+#define STORE_BENCH_PAGES 4096
+
+typedef struct {
+    page_store_t *store;
+    uint16_t text[25][40];
+} store_arg_t;
+
+static void run_store_update(void *arg, uint64_t iterations) {
+    store_arg_t *a = arg;
+    for (uint64_t i = 0; i < iterations; i++) {
+        for (uint16_t j = 0; j < STORE_BENCH_PAGES; j++) {
+            a->text[1][0] = i + j;
+            store_update(a->store, 0x100 + (j >> 2), j & 0x03, (const uint16_t (*)[40]) a->text, 0x0e, i);
+        }
+    }
+}
+
+static void run_store_lookup(void *arg, uint64_t iterations) {
+    store_arg_t *a = arg;
+    uint64_t s = 0;
+    for (uint64_t i = 0; i < iterations; i++)
+        for (uint16_t j = 0; j < STORE_BENCH_PAGES; j++) s += store_lookup(a->store, 0x100 + (j >> 2), j & 0x03)->version;
+    sink += s;
+}
+
+static telx_decoder_t *bench_decoder(uint16_t pid, uint16_t page) {
+    telx_decoder_t *dec = telx_new(0, output_sink, NULL);
+    if ((dec == NULL) || (telx_subscribe(dec, pid, page, NULL) == -1))
+        errx(1, "unable to set up decoder");
+    return dec;
+}
+
+int main(int argc, char *argv[]) {
+    uint16_t page = SYNTH_PAGE;
+    const char **files = calloc(argc, sizeof(char *));
+    int file_count = 0;
+    int c;
+
+    if (files == NULL)
+        err(1, "calloc");
+    while ((c = getopt(argc, argv, "ur:t:p:f:")) != -1) {
+        switch (c) {
+            case 'u':
+                unfiltered = YES;
+                break;
+            case 'f':
+                files[file_count++] = optarg;
+                break;
+            case 'r':
+                repetitions = strtoul(optarg, NULL, 10);
+                break;
+            case 't':
+                repetition_ms = strtoul(optarg, NULL, 10);
+                break;
+            case 'p': {
+                unsigned long p = strtoul(optarg, NULL, 10);
+                page = ((p / 100) << 8) | (((p / 10) % 10) << 4) | (p % 10);
+                break;
+            }
+            default:
+                errx(1, "usage: teletext-bench [-u] [-r repetitions] [-t ms per repetition] [-p page] [-f file.ts] [file.ts ...]");
+        }
+    }
+    for (int i = optind; i < argc; i++)
+        files[file_count++] = argv[i];
+    if ((repetitions == 0) || (repetition_ms == 0))
+        errx(1, "repetitions and ms per repetition must be positive");
+
+    init_ham_8_4();
+    for (uint32_t a = 0; a < (1 << 24); a++) {
+        if (unham_24_18(a) != unham_24_18_reference(a))
+            errx(1, "unham_24_18(%06x) = %05x, expected %05x", a, unham_24_18(a), unham_24_18_reference(a));
+    }
+    for (uint32_t d = 0; d < (1 << 18); d++) {
+        if (unham_24_18(ham_24_18(d)) != d)
+            errx(1, "Hamming 24/18 encoder does not match decoder (%05x)", d);
+    }
+    printf("unham_24_18 matches the reference decoder for all 2^24 inputs\n");
+    verify_kernels();
+    printf("%u kernel implementations verified, using %s\n", KERNEL_COUNT, kernels->name);
+
+    printf("%u repetitions of at least %u ms each, median per operation\n\n", repetitions, repetition_ms);
+
+    // TS demultiplexing, PES assembly and decoding of a full mux
+    ts_arg_t mux = { .dec = bench_decoder(SYNTH_TELETEXT_PID, SYNTH_PAGE), .ts = synth_mux() };
+    measure_ts("ts_mux", &mux);
+
+    ts_arg_t mux_pcr = { .dec = bench_decoder(SYNTH_TELETEXT_PID, SYNTH_PAGE), .ts = mux.ts };
+    telx_set_pcr_pid(mux_pcr.dec, SYNTH_PCR_PID);
+    measure_ts("ts_mux_pcr_pid", &mux_pcr);
+
+    // teletext packets only, every one renders a page
+    ts_arg_t teletext = { .dec = bench_decoder(SYNTH_TELETEXT_PID, SYNTH_PAGE), .ts = synth_teletext() };
+    measure(&(benchmark_t) { "ts_teletext", "packet", run_ts, &teletext, teletext.ts.count });
+
+    pes_arg_t pes = { .dec = bench_decoder(SYNTH_TELETEXT_PID, SYNTH_PAGE) };
+    pes.stream = pes.dec->streams[0];
+    memcpy(pes.pes, &teletext.ts.packets[4], sizeof(pes.pes));
+    measure(&(benchmark_t) { "process_pes_payload", "PES", run_pes, &pes, 1 });
+
+    // valid codewords with a single bit error in every 8th one
+    codes_arg_t codes;
+    srand(1);
+    for (uint16_t j = 0; j < 4096; j++) {
+        codes.bytes[j] = HAM_8_4[rand() & 0x0f];
+        codes.words[j] = ham_24_18(rand() & 0x3ffff);
+        if ((j & 0x07) == 0) {
+            codes.bytes[j] ^= 1 << (rand() & 0x07);
+            codes.words[j] ^= 1 << (rand() % 24);
+        }
+    }
+    measure(&(benchmark_t) { "unham_8_4", "byte", run_unham_8_4, &codes, 4096 });
+    measure(&(benchmark_t) { "unham_24_18", "triplet", run_unham_24_18, &codes, 4096 });
+    measure(&(benchmark_t) { "unham_24_18_reference", "triplet", run_unham_24_18_reference, &codes, 4096 });
+
+    // printable characters with correct parity
+    for (uint16_t j = 0; j < 4096; j++) codes.bytes[j] = parity(0x20 + rand() % 0x60);
+    measure(&(benchmark_t) { "telx_to_ucs2", "char", run_telx_to_ucs2, &codes, 4096 });
+
+    // data units of random bytes
+    kernel_arg_t kernel;
+    for (uint8_t j = 0; j < 64; j++)
+        for (uint8_t i = 0; i < 44; i++) kernel.units[j][i] = rand();
+    for (uint8_t j = 0; j < 64; j++)
+        for (uint8_t i = 0; i < 40; i++) kernel.rows[j][i] = random_cell();
+    for (unsigned int k = 0; k < KERNEL_COUNT; k++) {
+        char name[64];
+        kernel.kernels = KERNELS[k];
+        snprintf(name, sizeof(name), "reverse_unit/%s", KERNELS[k]->name);
+        measure(&(benchmark_t) { name, "unit", run_reverse_unit, &kernel, 64 });
+    }
+    for (unsigned int k = 0; k < KERNEL_COUNT; k++) {
+        char name[64];
+        kernel.kernels = KERNELS[k];
+        snprintf(name, sizeof(name), "row_bitmaps/%s", KERNELS[k]->name);
+        measure(&(benchmark_t) { name, "row", run_row_bitmaps, &kernel, 64 });
+    }
+    measure(&(benchmark_t) { "decode_row", "row", run_decode_row, &kernel, 64 });
+
+    // two boxed rows, coloured, with entities and national characters
+    page_arg_t render = { .dec = bench_decoder(SYNTH_TELETEXT_PID, SYNTH_PAGE) };
+    render.decoder = render.dec->streams[0]->pages[0];
+    const uint16_t row[] = { 0x03, 0x0b, 0x0b, 'S', 'u', 'b', 't', 0xe5, 't', 'e', 'l', ' ', '<', '&', '>', ' ', 0x06,
+        'c', 'y', 'a', 'n', ' ', 0x00e4, 0x00f6, 0x0a };
+    for (uint8_t y = 20; y <= 22; y += 2)
+        for (uint8_t i = 0; i < ARRAY_LENGTH(row); i++) set_cell(&render.decoder->page_buffer, y, i + 2, row[i]);
+    render.decoder->page_buffer.tainted = YES;
+    render.changing = YES;
+    measure(&(benchmark_t) { "process_page/changed", "page", run_process_page, &render, 1 });
+    render.changing = NO;
+    measure(&(benchmark_t) { "process_page/repeated", "page", run_process_page, &render, 1 });
+
+    static store_arg_t store;
+    store.store = store_new(STORE_BENCH_PAGES);
+    if (store.store == NULL)
+        err(1, "store_new");
+    measure(&(benchmark_t) { "store_update", "page", run_store_update, &store, STORE_BENCH_PAGES });
+    measure(&(benchmark_t) { "store_lookup", "page", run_store_lookup, &store, STORE_BENCH_PAGES });
+
+    // recorded files, whole file per iteration; the decoder logs are thrown away while measuring only
+    int saved_stderr = -1, dev_null = -1;
+    if (file_count > 0) {
+        saved_stderr = dup(STDERR_FILENO);
+        if (saved_stderr == -1)
+            err(1, "dup");
+        dev_null = open("/dev/null", O_WRONLY);
+        if (dev_null == -1)
+            err(1, "/dev/null");
+    }
+    for (int i = 0; i < file_count; i++) {
+        ts_arg_t file = { .dec = bench_decoder(PID_ANY, page), .ts = load_file(files[i]) };
+        char name[64];
+        snprintf(name, sizeof(name), "file:%s", files[i]);
+        fflush(stderr);
+        if (dup2(dev_null, STDERR_FILENO) == -1)
+            err(1, "dup2");
+        measure_ts(name, &file);
+        fflush(stderr);
+        if (dup2(saved_stderr, STDERR_FILENO) == -1)
+            return 1;
+    }
+    if (file_count > 0) {
+        close(dev_null);
+        close(saved_stderr);
+    }
+
+    return 0;
+}
@@ -0,0 +1,176 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#include <err.h>
+#include "capture.h"
+#include "pipeline.h"
+#include "replay.h"
+
+// pcap link type of frames received by a SOCK_DGRAM packet socket, starting with the IPv4 header
+#define LINKTYPE_IPV4 228
+
+// classic BPF accepting unfragmented IPv4 UDP to one of the groups of channels; frames start with the IPv4 header
+static void attach_filter(int s, channel_t *channels, int channel_count) {
+    in_addr_t groups[CAPTURE_FILTER_GROUPS];
+    int group_count = 0;
+    for (int i = 0; (i < channel_count) && (group_count <= CAPTURE_FILTER_GROUPS); i++) {
+        int known = 0;
+        for (int j = 0; j < group_count; j++) known |= (groups[j] == channels[i].addr);
+        if (known) continue;
+        if (group_count == CAPTURE_FILTER_GROUPS) {
+            group_count++;
+            break;
+        }
+        groups[group_count++] = channels[i].addr;
+    }
+    // too many groups for 8 bit jump offsets, any multicast group is accepted
+    uint8_t any = (group_count > CAPTURE_FILTER_GROUPS) ? YES : NO;
+    int n = (any == YES) ? 2 : group_count;
+
+    struct sock_filter code[CAPTURE_FILTER_GROUPS + 7];
+    int drop = 5 + n, accept = drop + 1, i = 0;
+    code[i++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9); // protocol
+    code[i] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 17, 0, drop - i - 1); i++;
+    code[i++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 6); // flags, fragment offset
+    code[i] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x3fff, drop - i - 1, 0); i++;
+    code[i++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 16); // destination address
+    if (any == YES) {
+        code[i++] = (struct sock_filter) BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xf0000000);
+        code[i] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0xe0000000, accept - i - 1, 0); i++;
+    } else {
+        for (int g = 0; g < group_count; g++, i++)
+            code[i] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohl(groups[g]), accept - i - 1, 0);
+    }
+    code[i++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0);
+    code[i++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, CAPTURE_FRAME_SIZE);
+
+    struct sock_fprog program = { .len = i, .filter = code };
+    if (setsockopt(s, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) == -1)
+        err(1, "SO_ATTACH_FILTER");
+    if (any == YES)
+        log_info("More than %u groups, capturing any multicast group", CAPTURE_FILTER_GROUPS);
+}
+
+// frames of a block handed over by the kernel
+static void capture_block(struct tpacket_block_desc *block, channel_t *channels, int channel_count) {
+    uint64_t now = monotonic_ns();
+    struct tpacket3_hdr *frame = (struct tpacket3_hdr *) ((uint8_t *) block + block->hdr.bh1.offset_to_first_pkt);
+
+    for (uint32_t i = 0; i < block->hdr.bh1.num_pkts; i++) {
+        in_addr_t addr;
+        uint16_t port;
+        size_t size;
+        uint8_t *datagram = frame_udp_payload((uint8_t *) frame + frame->tp_mac, frame->tp_snaplen, LINKTYPE_IPV4, &addr, &port, &size);
+
+        uint8_t fec = NO;
+        channel_t *channel = (datagram != NULL) ? find_channel(channels, channel_count, addr, port, &fec) : NULL;
+        if (channel != NULL) {
+            if (channel->worker != NULL)
+                pipeline_queue(channel, datagram, size, fec);
+            else
+                process_channel_datagram(channel, datagram, size, fec, now);
+        }
+
+        frame = (struct tpacket3_hdr *) ((uint8_t *) frame + frame->tp_next_offset);
+    }
+}
+
+void capture_channels(const char *interface, channel_t *channels, int channel_count, output_t *output) {
+    unsigned int ifindex = if_nametoindex(interface);
+    if (ifindex == 0)
+        err(1, "%s", interface);
+
+    // IPv4 packets without link layer header
+    int s = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_IP));
+    if (s == -1)
+        err(1, "socket(AF_PACKET)");
+
+    // filter is in place before the first frame is received
+    attach_filter(s, channels, channel_count);
+
+    int version = TPACKET_V3;
+    if (setsockopt(s, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) == -1)
+        err(1, "PACKET_VERSION");
+
+    struct tpacket_req3 req = {
+        .tp_block_size = CAPTURE_BLOCK_SIZE,
+        .tp_block_nr = CAPTURE_BLOCKS,
+        .tp_frame_size = CAPTURE_FRAME_SIZE,
+        .tp_frame_nr = (CAPTURE_BLOCK_SIZE / CAPTURE_FRAME_SIZE) * CAPTURE_BLOCKS,
+        .tp_retire_blk_tov = CAPTURE_BLOCK_TIMEOUT
+    };
+    if (setsockopt(s, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) == -1)
+        err(1, "PACKET_RX_RING");
+
+    size_t ring_size = (size_t) CAPTURE_BLOCK_SIZE * CAPTURE_BLOCKS;
+    uint8_t *ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, s, 0);
+    if (ring == MAP_FAILED)
+        err(1, "mmap(PACKET_RX_RING)");
+
+    struct sockaddr_ll sll = { 0 };
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_IP);
+    sll.sll_ifindex = ifindex;
+    if (bind(s, (struct sockaddr *) &sll, sizeof(sll)) == -1)
+        err(1, "bind(%s)", interface);
+
+    // channels decoded by this thread
+    expiry_t expiry = { 0 };
+    for (int i = 0; i < channel_count; i++)
+        if (channels[i].worker == NULL) expiry_add(&expiry, &channels[i]);
+
+    log_info("Capturing %d channels on %s", channel_count, interface);
+
+    struct pollfd pfd = { .fd = s, .events = POLLIN | POLLERR };
+    struct { uint64_t packets; uint64_t drops; uint64_t freezes; } stats = { 0 };
+    time_t reported = time(NULL);
+    unsigned int current = 0;
+
+    while (1) {
+        struct tpacket_block_desc *block = (struct tpacket_block_desc *) (ring + (size_t) current * CAPTURE_BLOCK_SIZE);
+
+        // wake up in time for the output deadline and for datagrams held too long, which are checked for
+        // while blocks keep arriving too
+        int timeout = (output != NULL) ? output_timeout(output) : -1;
+        timeout = expiry_timeout(&expiry, timeout);
+
+        if ((__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0) {
+            if ((poll(&pfd, 1, timeout) == -1) && (errno != EINTR))
+                err(1, "poll");
+        } else {
+            capture_block(block, channels, channel_count);
+            __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+            current = (current + 1) % CAPTURE_BLOCKS;
+        }
+
+        if (output != NULL)
+            output_poll(output);
+
+        time_t now = time(NULL);
+        if (now - reported >= CAPTURE_STATS_INTERVAL) {
+            struct tpacket_stats_v3 ring_stats;
+            socklen_t length = sizeof(ring_stats);
+            // counters are reset by every read
+            if (getsockopt(s, SOL_PACKET, PACKET_STATISTICS, &ring_stats, &length) == 0) {
+                stats.packets += ring_stats.tp_packets;
+                stats.drops += ring_stats.tp_drops;
+                stats.freezes += ring_stats.tp_freeze_q_cnt;
+            }
+            log_info("%s: %"PRIu64" frames, %"PRIu64" dropped, ring full %"PRIu64" times", interface, stats.packets, stats.drops, stats.freezes);
+            reported = now;
+        }
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef CAPTURE_H_INCLUDED
+#define CAPTURE_H_INCLUDED
+
+#include "ingest.h"
+#include "output.h"
+
+// TPACKET_V3 ring: blocks are handed over between kernel and user space as a whole, 64 MiB in total
+#define CAPTURE_BLOCK_SIZE (1 << 20)
+#define CAPTURE_BLOCKS 64
+// upper limit of a frame; datagrams are at most MAX_DATAGRAM_SIZE long
+#define CAPTURE_FRAME_SIZE 2048
+// a block is handed over partially filled at the latest after this time (in ms)
+#define CAPTURE_BLOCK_TIMEOUT 10
+
+// largest number of groups matched one by one in the BPF filter, any multicast group passes beyond it
+#define CAPTURE_FILTER_GROUPS 250
+
+// how often ring statistics are logged (in seconds)
+#define CAPTURE_STATS_INTERVAL 60
+
+// receives every channel through a single AF_PACKET socket on interface; UDP to the groups of channels is
+// filtered in the kernel, datagrams are demultiplexed by group:port and decoded straight from the ring,
+// or copied into the queue of the channel's worker; never returns
+void capture_channels(const char *interface, channel_t *channels, int channel_count, output_t *output);
+
+#endif
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fec.h"
+
+typedef enum {
+    FEC_PENDING = 0, // more than one protected datagram missing, may be recovered later
+    FEC_COMPLETE, // nothing to recover
+    FEC_RECOVERED
+} fec_result_t;
+
+fec_t *fec_new(const char *name, fec_recover_cb_t recover, void *opaque) {
+    fec_t *f = calloc(1, sizeof(fec_t));
+    if (f == NULL)
+        return NULL;
+
+    f->name = name;
+    f->recover = recover;
+    f->opaque = opaque;
+    return f;
+}
+
+void fec_free(fec_t *f) {
+    free(f);
+}
+
+void fec_media(fec_t *f, const uint8_t *datagram, size_t size) {
+    if ((size < RTP_HEADER_SIZE) || (size > MAX_DATAGRAM_SIZE) || (datagram[0] == 0x47) || !rtp_check_hdr(datagram))
+        return;
+
+    uint16_t seqnum = rtp_get_seqnum(datagram);
+    if ((f->started == NO) || ((int16_t) (seqnum - f->highest) > 0)) f->highest = seqnum;
+    f->started = YES;
+    fec_slot_t *slot = &f->history[seqnum & (FEC_HISTORY - 1)];
+    slot->seqnum = seqnum;
+    slot->length = size;
+    memcpy(slot->data, datagram, size);
+}
+
+// FEC header, NULL if not a valid XOR FEC packet
+static const uint8_t *fec_header(const uint8_t *datagram, size_t size) {
+    if ((size < RTP_HEADER_SIZE) || !rtp_check_hdr(datagram))
+        return NULL;
+    size_t offset = RTP_HEADER_SIZE + 4 * rtp_get_cc(datagram);
+    if (size < offset + FEC_HEADER_SIZE)
+        return NULL;
+
+    const uint8_t *h = datagram + offset;
+    // extension flag (E) set, XOR (type 0), at least one datagram protected, all of them in the history
+    uint8_t offset_field = h[13], na = h[14];
+    if (((h[4] & 0x80) == 0) || (((h[12] >> 3) & 0x07) != 0) || (offset_field == 0) || (na == 0) ||
+        ((na - 1) * offset_field >= FEC_HISTORY))
+        return NULL;
+    return h;
+}
+
+// tries to recover the media datagram protected by FEC packet, if it is the only one missing
+static fec_result_t try_recover(fec_t *f, const uint8_t *datagram, size_t size, uint64_t now) {
+    const uint8_t *h = fec_header(datagram, size);
+    const uint8_t *payload = h + FEC_HEADER_SIZE;
+    size_t payload_length = size - (payload - datagram);
+    if (payload_length > MAX_DATAGRAM_SIZE - RTP_HEADER_SIZE)
+        return FEC_COMPLETE;
+
+    // protected sequence numbers are SNBase + j * Offset, j < NA
+    uint16_t base = (h[0] << 8) | h[1];
+    uint8_t offset = h[13], na = h[14];
+    uint16_t missing = 0;
+    unsigned int missing_count = 0;
+    for (uint8_t j = 0; j < na; j++) {
+        uint16_t seqnum = base + j * offset;
+        // older than the history: its slot may hold a newer datagram, it is not missing but long gone
+        if ((f->started == YES) && ((int16_t) (f->highest - seqnum) >= FEC_HISTORY))
+            return FEC_COMPLETE;
+        const fec_slot_t *slot = &f->history[seqnum & (FEC_HISTORY - 1)];
+        if ((slot->length > 0) && (slot->seqnum == seqnum)) continue;
+        missing = seqnum;
+        if (++missing_count > 1) return FEC_PENDING;
+    }
+    if (missing_count == 0)
+        return FEC_COMPLETE;
+
+    // RFC 2733, chapter 7: XOR of the FEC packet and every other protected datagram; RTP header bits
+    // P, X, CC and M come from the FEC packet's RTP header, PT, timestamp and length from the FEC header
+    uint8_t recovered[MAX_DATAGRAM_SIZE] = { 0 };
+    uint8_t bits = datagram[0] & 0x3f;
+    uint8_t marker_pt = (datagram[1] & 0x80) | (h[4] & 0x7f);
+    uint32_t timestamp = (h[8] << 24) | (h[9] << 16) | (h[10] << 8) | h[11];
+    size_t length = (h[2] << 8) | h[3];
+    const uint8_t *ssrc = &datagram[8];
+    memcpy(&recovered[RTP_HEADER_SIZE], payload, payload_length);
+
+    for (uint8_t j = 0; j < na; j++) {
+        uint16_t seqnum = base + j * offset;
+        if (seqnum == missing) continue;
+
+        const fec_slot_t *slot = &f->history[seqnum & (FEC_HISTORY - 1)];
+        bits ^= slot->data[0] & 0x3f;
+        marker_pt ^= slot->data[1];
+        timestamp ^= rtp_get_timestamp(slot->data);
+        length ^= slot->length - RTP_HEADER_SIZE;
+        ssrc = &slot->data[8];
+        for (size_t k = RTP_HEADER_SIZE; k < slot->length; k++)
+            recovered[k] ^= slot->data[k];
+    }
+    if (length > payload_length) {
+        f->stats.invalid++;
+        return FEC_COMPLETE;
+    }
+
+    recovered[0] = 0x80 | bits;
+    recovered[1] = marker_pt;
+    rtp_set_seqnum(recovered, missing);
+    rtp_set_timestamp(recovered, timestamp);
+    memcpy(&recovered[8], ssrc, 4);
+
+    fec_media(f, recovered, RTP_HEADER_SIZE + length);
+    if (f->recover(f->opaque, recovered, RTP_HEADER_SIZE + length, now) == NO)
+        return FEC_COMPLETE;
+    f->stats.recovered++;
+    return FEC_RECOVERED;
+}
+
+void fec_packet(fec_t *f, const uint8_t *datagram, size_t size, uint64_t now) {
+    f->stats.packets++;
+    if ((size > MAX_DATAGRAM_SIZE) || (fec_header(datagram, size) == NULL)) {
+        f->stats.invalid++;
+        return;
+    }
+
+    fec_result_t result = try_recover(f, datagram, size, now);
+    if (result == FEC_PENDING) {
+        fec_slot_t *slot = &f->packets[f->next_packet];
+        f->next_packet = (f->next_packet + 1) % FEC_PACKETS;
+        slot->length = size;
+        memcpy(slot->data, datagram, size);
+    }
+
+    // kept FEC packets may have become recoverable, by this recovery or datagrams received late
+    uint8_t progress = YES;
+    while (progress == YES) {
+        progress = NO;
+        for (unsigned int i = 0; i < FEC_PACKETS; i++) {
+            fec_slot_t *slot = &f->packets[i];
+            if (slot->length == 0) continue;
+
+            result = try_recover(f, slot->data, slot->length, now);
+            if (result == FEC_PENDING) continue;
+            slot->length = 0;
+            if (result == FEC_RECOVERED) progress = YES;
+        }
+    }
+
+    if (f->stats.reported == 0) f->stats.reported = now;
+    if (now >= f->stats.reported + FEC_STATS_INTERVAL) {
+        fec_log(f);
+        f->stats.reported = now;
+    }
+}
+
+void fec_log(const fec_t *f) {
+    log_info("%s: FEC %"PRIu64" packets (%"PRIu64" invalid), %"PRIu64" datagrams recovered",
+        f->name, f->stats.packets, f->stats.invalid, f->stats.recovered);
+}
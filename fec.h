@@ -0,0 +1,63 @@
+#ifndef FEC_H_INCLUDED
+#define FEC_H_INCLUDED
+
+#include <stddef.h>
+#include <inttypes.h>
+#include "ingest.h"
+
+// SMPTE 2022-1 FEC streams are sent to the media port plus these
+#define FEC_COLUMN_PORT_OFFSET 2
+#define FEC_ROW_PORT_OFFSET 4
+
+// media datagrams kept for recovery, a power of two; two matrices of at most 100 datagrams
+#define FEC_HISTORY 256
+
+// FEC packets kept until every datagram they protect is known
+#define FEC_PACKETS 64
+
+// FEC header following the RTP header, ETSI TS 102 034 / SMPTE 2022-1 (RFC 2733 with the extension)
+#define FEC_HEADER_SIZE 16
+
+// how often statistics are logged (in ns), 60 s
+#define FEC_STATS_INTERVAL 60000000000ULL
+
+// RTP datagram, media or FEC
+typedef struct {
+    uint16_t seqnum; // media datagrams only
+    uint16_t length; // 0 = empty
+    uint8_t data[MAX_DATAGRAM_SIZE];
+} fec_slot_t;
+
+// called with every media datagram recovered, now as given to fec_packet(); returns NO if it was not missing
+// anymore after all (received meanwhile, or given up), so it does not count as recovered
+typedef uint8_t (*fec_recover_cb_t)(void *opaque, uint8_t *datagram, size_t size, uint64_t now);
+
+// XOR recovery of lost media datagrams from column and row FEC; the media datagrams received last are kept
+// in a history, FEC packets that can not recover anything yet are kept and tried again after every
+// recovery, so column and row FEC repair what either one alone can not
+typedef struct fec {
+    const char *name; // log prefix
+    fec_recover_cb_t recover;
+    void *opaque;
+    unsigned int next_packet; // FEC packets slot taken next
+    uint8_t started; // YES = highest is set
+    uint16_t highest; // highest media sequence number kept, older ones than FEC_HISTORY are overwritten
+    struct {
+        uint64_t packets; // FEC packets received
+        uint64_t invalid;
+        uint64_t recovered;
+        uint64_t reported; // logged at time (in ns)
+    } stats;
+    fec_slot_t history[FEC_HISTORY];
+    fec_slot_t packets[FEC_PACKETS];
+} fec_t;
+
+fec_t *fec_new(const char *name, fec_recover_cb_t recover, void *opaque);
+void fec_free(fec_t *f);
+// media datagram received, kept for recovery
+void fec_media(fec_t *f, const uint8_t *datagram, size_t size);
+// FEC packet received at time now (in ns)
+void fec_packet(fec_t *f, const uint8_t *datagram, size_t size, uint64_t now);
+void fec_log(const fec_t *f);
+
+#endif
@@ -0,0 +1,128 @@
+/*!
+(c) 2011-2014 Forers, s. r. o.: telxcc
+*/
+
+/*
+Generates tables.c, the lookup tables declared in hamming.h and teletext.h.
+
+Hamming 8/4, Hamming 24/18, parity and bit order tables are computed from ETS 300 706, chapters 7.1, 8.2 and 8.3.
+Fused tables combine them with the character sets of charsets.c, so that bytes as transmitted are decoded
+in a single lookup.
+
+usage: gentables > tables.c
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "hamming.h"
+#include "teletext.h"
+
+static uint8_t parity_8[256];
+static uint8_t reverse_8[256];
+static uint8_t unham_8_4[256];
+static uint16_t reverse_unham_8_4_16[65536];
+static uint8_t unham_24_18_parity[3][256];
+static uint32_t unham_24_18_error[64];
+static uint16_t g0_latin_subsets[G0_LATIN_NATIONAL_SUBSET_COUNT][96];
+static uint16_t reverse_parity_g0_latin[G0_LATIN_NATIONAL_SUBSET_COUNT][256];
+
+// ETS 300 706, chapter 8.2: data bits D1-D4 in bits 1, 3, 5, 7, protection bits P1-P4 in bits 0, 2, 4, 6
+static uint8_t ham_8_4(uint8_t d) {
+    uint8_t d1 = d & 0x01, d2 = (d >> 1) & 0x01, d3 = (d >> 2) & 0x01, d4 = (d >> 3) & 0x01;
+    uint8_t p1 = 1 ^ d1 ^ d3 ^ d4;
+    uint8_t p2 = 1 ^ d1 ^ d2 ^ d4;
+    uint8_t p3 = 1 ^ d1 ^ d2 ^ d3;
+    uint8_t p4 = 1 ^ p1 ^ d1 ^ p2 ^ d2 ^ p3 ^ d3 ^ d4;
+    return p1 | (d1 << 1) | (p2 << 2) | (d2 << 3) | (p3 << 4) | (d3 << 5) | (p4 << 6) | (d4 << 7);
+}
+
+static void generate(void) {
+    for (uint16_t a = 0; a < 256; a++) {
+        parity_8[a] = __builtin_parity(a);
+
+        reverse_8[a] = 0;
+        for (uint8_t i = 0; i < 8; i++) if ((a >> i) & 0x01) reverse_8[a] |= 0x80 >> i;
+
+        // single bit errors are corrected, more of them are not (codewords are 4 bits apart)
+        unham_8_4[a] = 0xff;
+        for (uint8_t d = 0; d < 16; d++) if (__builtin_popcount(a ^ ham_8_4(d)) <= 1) unham_8_4[a] = d;
+    }
+
+    for (uint32_t a = 0; a < 65536; a++) {
+        uint8_t n0 = unham_8_4[reverse_8[a & 0xff]], n1 = unham_8_4[reverse_8[a >> 8]];
+        reverse_unham_8_4_16[a] = ((n0 == 0xff) || (n1 == 0xff)) ? UNHAM_ERROR : 0;
+        reverse_unham_8_4_16[a] |= (n0 & 0x0f) | ((n1 & 0x0f) << 4);
+    }
+
+    // tests A-E are the bits of the 1-based position of every set bit (bit 5, test F, is overall parity);
+    // bit 24 is covered by test F only
+    for (uint8_t k = 0; k < 3; k++) {
+        for (uint16_t b = 0; b < 256; b++) {
+            uint8_t test = 0;
+            for (uint8_t j = 0; j < 8; j++) {
+                uint8_t i = k * 8 + j;
+                if ((b >> j) & 0x01) test ^= (i == 23) ? 32 : (i + 33);
+            }
+            unham_24_18_parity[k][b] = test;
+        }
+    }
+    for (uint8_t test = 0; test < 64; test++) {
+        // all tests A-E correct: no error (or error in bit 24 only); test F correct otherwise: double error
+        if ((test & 0x1f) == 0x1f) unham_24_18_error[test] = 0;
+        else if ((test & 0x20) == 0x20) unham_24_18_error[test] = 0xffffffff;
+        else unham_24_18_error[test] = 1 << (30 - test);
+    }
+
+    for (uint8_t m = 0; m < G0_LATIN_NATIONAL_SUBSET_COUNT; m++) {
+        uint16_t *g0 = g0_latin_subsets[m];
+        memcpy(g0, G0[LATIN], sizeof(g0_latin_subsets[m]));
+        for (uint8_t j = 0; j < 13; j++) g0[G0_LATIN_NATIONAL_SUBSETS_POSITIONS[j]] = G0_LATIN_NATIONAL_SUBSETS[m].characters[j];
+
+        for (uint16_t a = 0; a < 256; a++) {
+            uint8_t c = reverse_8[a];
+            if (parity_8[c] == 0) reverse_parity_g0_latin[m][a] = 0x20 | PARITY_ERROR;
+            else reverse_parity_g0_latin[m][a] = ((c & 0x7f) >= 0x20) ? g0[(c & 0x7f) - 0x20] : (c & 0x7f);
+        }
+    }
+}
+
+// prints table of count values size bytes wide, per_line values per line, in blocks of block values (0 = flat)
+static void emit(const char *comment, const char *declaration, const void *data, uint8_t size, size_t count, uint8_t per_line, size_t block) {
+    printf("// %s\n%s = {\n", comment, declaration);
+
+    const char *indent = (block > 0) ? "        " : "    ";
+    if (block == 0) block = count;
+    for (size_t i = 0; i < count; i++) {
+        if ((i % block == 0) && (block < count)) printf("%s    {\n", (i > 0) ? ",\n" : "");
+        else if (i % per_line == 0) printf("%s", (i > 0) ? ",\n" : "");
+        else printf(", ");
+
+        if (i % per_line == 0) printf("%s", indent);
+
+        if (size == 1) printf("0x%02x", ((const uint8_t *) data)[i]);
+        else if (size == 2) printf("0x%04x", ((const uint16_t *) data)[i]);
+        else printf("0x%08x", ((const uint32_t *) data)[i]);
+
+        if ((i % block == block - 1) && (block < count)) printf("\n    }");
+    }
+    printf("\n};\n\n");
+}
+
+int main(void) {
+    generate();
+
+    printf("// generated by gentables, do not edit\n\n#include \"hamming.h\"\n#include \"teletext.h\"\n\n");
+    emit("odd parity of a byte, 1 = parity check passed", "const uint8_t PARITY_8[256]", parity_8, 1, 256, 16, 0);
+    emit("bit order reversed", "const uint8_t REVERSE_8[256]", reverse_8, 1, 256, 16, 0);
+    emit("Hamming 8/4 decoded nibble, 0xff = uncorrectable error", "const uint8_t UNHAM_8_4[256]", unham_8_4, 1, 256, 16, 0);
+    emit("two bit reversed Hamming 8/4 bytes decoded", "const uint16_t REVERSE_UNHAM_8_4_16[65536]", reverse_unham_8_4_16, 2, 65536, 16, 0);
+    emit("Hamming 24/18 tests A-F of every byte of a triplet", "const uint8_t UNHAM_24_18_PARITY[3][256]", unham_24_18_parity, 1, 3 * 256, 16, 256);
+    emit("Hamming 24/18 syndrome -> bit flip", "const uint32_t UNHAM_24_18_ERROR[64]", unham_24_18_error, 4, 64, 8, 0);
+    emit("G0 Latin of every national subset", "const uint16_t G0_LATIN_SUBSETS[G0_LATIN_NATIONAL_SUBSET_COUNT][96]",
+        g0_latin_subsets, 2, G0_LATIN_NATIONAL_SUBSET_COUNT * 96, 16, 96);
+    emit("bit reversed, parity checked G0 Latin character of every national subset",
+        "const uint16_t REVERSE_PARITY_G0_LATIN[G0_LATIN_NATIONAL_SUBSET_COUNT][256]", reverse_parity_g0_latin, 2, G0_LATIN_NATIONAL_SUBSET_COUNT * 256, 16, 256);
+
+    return 0;
+}
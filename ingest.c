@@ -0,0 +1,917 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <err.h>
+#include <unistd.h>
+#include "ingest.h"
+#include "pipeline.h"
+#include "replay.h"
+#include "reorder.h"
+#include "fec.h"
+#include "capture.h"
+#include "uring.h"
+#include "rxconf.h"
+#include "output.h"
+
+// upper limit of datagrams fetched by a single recvmmsg() call
+#define MAX_RECV_BATCH 1024
+
+// how often receive statistics are logged (in seconds)
+#define RECV_STATS_INTERVAL 60
+
+// maximum number of epoll events handled per epoll_wait() call
+#define MAX_EPOLL_EVENTS 64
+
+// maximum number of datagrams read from one socket before other sockets get their turn
+#define MAX_DRAIN_DATAGRAMS 256
+
+// upper limit of pipeline worker threads
+#define MAX_WORKERS 256
+
+// receive backends, selected by -I
+typedef enum {
+    BACKEND_RECV = 0, // one datagram per recv() call
+    BACKEND_RECVMMSG, // up to batch datagrams per recvmmsg() call
+    BACKEND_URING // multishot recvmsg into io_uring provided buffers
+} backend_t;
+
+static const char *backend_names[] = { "recv", "recvmmsg", "io_uring" };
+
+// receive buffers and statistics, shared by all sockets served by one thread
+typedef struct {
+    backend_t backend; // BACKEND_RECV or BACKEND_RECVMMSG
+    unsigned int batch;
+    uint8_t *ring; // preallocated ring of batch datagram buffers
+    struct iovec *iov;
+    struct mmsghdr *msgs;
+    uint8_t *control; // RXCONF_CONTROL_SIZE bytes of control messages per datagram
+    output_t *output; // flushed on its deadline by the receiving thread, NULL = owned by another thread
+    // receive statistics, used for batch size tuning
+    struct {
+        uint64_t calls;
+        uint64_t datagrams;
+        uint64_t full_batches;
+        time_t reported;
+    } stats;
+    rxconf_stats_t sockets;
+    expiry_t expiry; // channels decoded by the receiving thread
+} receiver_t;
+
+void process_datagram(telx_decoder_t *dec, uint8_t *buffer, ssize_t size) {
+    uint8_t *packet = buffer;
+    uint8_t *end = buffer + size;
+
+    // RTP version 2 header never starts with 0x47
+    if ((size > 0) && (buffer[0] != 0x47)) {
+        if ((size < RTP_HEADER_SIZE) || !rtp_check_hdr(buffer) ||
+            (rtp_check_extension(buffer) && (size < RTP_HEADER_SIZE + 4 * rtp_get_cc(buffer) + RTP_EXTENSION_SIZE))) {
+            log_warn("Invalid RTP packet received. Skipping");
+            return;
+        }
+        // CSRCs and header extension are skipped
+        packet = rtp_payload(buffer);
+    }
+
+    // 1 to 7 TS packets usually; bytes preceding a sync byte are skipped
+    while (end - packet >= TS_SIZE) {
+        if (packet[0] != 0x47) {
+            log_warn("TS sync byte missing in datagram, resynchronizing");
+            packet = memchr(packet + 1, 0x47, end - packet - 1);
+            if (packet == NULL)
+                return;
+            continue;
+        }
+
+        unsigned int count = 1;
+        while ((end - packet >= (count + 1) * TS_SIZE) && (packet[count * TS_SIZE] == 0x47))
+            count++;
+        telx_feed_ts_burst(dec, packet, count);
+        packet += count * TS_SIZE;
+    }
+}
+
+static void deliver_datagram(void *opaque, uint8_t *datagram, size_t size) {
+    process_datagram(opaque, datagram, size);
+}
+
+// recovered datagrams take the place of the lost ones in the reorder window, unless they have been
+// received meanwhile or given up
+static uint8_t recover_datagram(void *opaque, uint8_t *datagram, size_t size, uint64_t now) {
+    channel_t *channel = opaque;
+    if (reorder_missing(channel->reorder, rtp_get_seqnum(datagram)) == NO)
+        return NO;
+    reorder_push(channel->reorder, datagram, size, now);
+    return YES;
+}
+
+// reorder window of channel; with FEC it is wide enough for column FEC to arrive
+static void reorder_channel(channel_t *channel) {
+    channel->reorder = (channel->fec != NULL) ?
+        reorder_new(channel->name, REORDER_FEC_WINDOW, REORDER_FEC_TIMEOUT, deliver_datagram, channel->dec) :
+        reorder_new(channel->name, REORDER_WINDOW, REORDER_TIMEOUT, deliver_datagram, channel->dec);
+    if (channel->reorder == NULL)
+        err(1, "reorder_new");
+}
+
+void process_channel_datagram(channel_t *channel, uint8_t *buffer, ssize_t size, uint8_t fec, uint64_t now) {
+    if (fec == YES) {
+        if ((channel->fec != NULL) && (size > 0))
+            fec_packet(channel->fec, buffer, size, now);
+        return;
+    }
+    // raw UDP has no sequence numbers, it is decoded as received without a window
+    if ((channel->reorder == NULL) && (size >= RTP_HEADER_SIZE) && (buffer[0] != 0x47) && rtp_check_hdr(buffer))
+        reorder_channel(channel);
+    if ((channel->reorder == NULL) || (size <= 0)) {
+        process_datagram(channel->dec, buffer, size);
+        return;
+    }
+    if (channel->fec != NULL)
+        fec_media(channel->fec, buffer, size);
+    reorder_push(channel->reorder, buffer, size, now);
+}
+
+// FEC recovery of every channel; FEC comes with RTP only, so the reorder window recovered datagrams go to
+// is set up right away
+static void fec_channels(channel_t *channels, int channel_count) {
+    for (int i = 0; i < channel_count; i++) {
+        channel_t *channel = &channels[i];
+        channel->fec = fec_new(channel->name, recover_datagram, channel);
+        if (channel->fec == NULL)
+            err(1, "fec_new");
+        reorder_channel(channel);
+    }
+}
+
+channel_t *find_channel(channel_t *channels, int channel_count, in_addr_t addr, uint16_t port, uint8_t *fec) {
+    for (int c = 0; c < channel_count; c++) {
+        if ((channels[c].addr != INADDR_ANY) && (channels[c].addr != addr)) continue;
+        if ((channels[c].port == 0) || (channels[c].port == port)) {
+            *fec = NO;
+            return &channels[c];
+        }
+        // SMPTE 2022-1 column and row FEC
+        if ((channels[c].fec != NULL) && ((port == channels[c].port + FEC_COLUMN_PORT_OFFSET) || (port == channels[c].port + FEC_ROW_PORT_OFFSET))) {
+            *fec = YES;
+            return &channels[c];
+        }
+    }
+    return NULL;
+}
+
+// SIGUSR1 received so far; page stores are dumped by the threads decoding their channels
+static volatile sig_atomic_t store_dump_requests = 0;
+
+static void request_store_dump(int signum) {
+    store_dump_requests++;
+}
+
+// page store of channel rendered at once, then passed to its output like a page, so that it is never
+// interleaved with pages of other channels
+static void dump_channel_store(channel_t *channel) {
+    char *data = NULL;
+    size_t length = 0;
+    FILE *f = open_memstream(&data, &length);
+    if (f == NULL) {
+        log_warn("Unable to dump page store of %s: %s", channel->name, strerror(errno));
+        return;
+    }
+    store_dump(channel->dec->store, f, channel->store_tag);
+    fclose(f);
+    if (length > 0)
+        channel->dec->output(channel->dec->opaque, data, length);
+    free(data);
+}
+
+void expiry_add(expiry_t *e, channel_t *channel) {
+    e->channels = realloc(e->channels, (e->count + 1) * sizeof(channel_t *));
+    if (e->channels == NULL)
+        err(1, "realloc");
+    e->channels[e->count++] = channel;
+}
+
+int expiry_timeout(expiry_t *e, int timeout) {
+    if (e->count == 0)
+        return timeout;
+
+    uint64_t now = monotonic_ns();
+    if (now >= e->due) {
+        e->due = now + REORDER_EXPIRY_INTERVAL;
+        for (int i = 0; i < e->count; i++) {
+            channel_t *channel = e->channels[i];
+            if (channel->reorder != NULL) {
+                uint64_t due = reorder_expire(channel->reorder, now);
+                if (due < e->due) e->due = due;
+            }
+            telx_tick(channel->dec, now / 1000000);
+            if ((channel->dec->store != NULL) && (channel->store_dumps != (unsigned int) store_dump_requests)) {
+                channel->store_dumps = store_dump_requests;
+                dump_channel_store(channel);
+            }
+        }
+    }
+
+    int wait = (e->due - now + 999999) / 1000000;
+    return ((timeout == -1) || (wait < timeout)) ? wait : timeout;
+}
+
+uint64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void receiver_init(receiver_t *r, backend_t backend, unsigned int batch, output_t *output) {
+    memset(r, 0, sizeof(receiver_t));
+    r->backend = backend;
+    r->batch = batch;
+    r->output = output;
+    r->ring = calloc(batch, MAX_DATAGRAM_SIZE);
+    r->iov = calloc(batch, sizeof(struct iovec));
+    r->msgs = calloc(batch, sizeof(struct mmsghdr));
+    r->control = calloc(batch, RXCONF_CONTROL_SIZE);
+    if ((r->ring == NULL) || (r->iov == NULL) || (r->msgs == NULL) || (r->control == NULL))
+        err(1, "calloc");
+
+    for (unsigned int i = 0; i < batch; i++) {
+        r->iov[i].iov_base = &r->ring[i * MAX_DATAGRAM_SIZE];
+        r->iov[i].iov_len = MAX_DATAGRAM_SIZE;
+        r->msgs[i].msg_hdr.msg_iov = &r->iov[i];
+        r->msgs[i].msg_hdr.msg_iovlen = 1;
+        r->msgs[i].msg_hdr.msg_control = &r->control[i * RXCONF_CONTROL_SIZE];
+        r->msgs[i].msg_hdr.msg_controllen = RXCONF_CONTROL_SIZE;
+    }
+    r->stats.reported = time(NULL);
+}
+
+// updates receive statistics, logs them every RECV_STATS_INTERVAL seconds
+static void receiver_account(receiver_t *r, int n) {
+    r->stats.calls++;
+    r->stats.datagrams += n;
+    if ((unsigned int) n == r->batch) r->stats.full_batches++;
+
+    time_t now = time(NULL);
+    if (now - r->stats.reported >= RECV_STATS_INTERVAL) {
+        log_info("%s: %"PRIu64" calls, %"PRIu64" datagrams, average batch fill %.2f/%u, %"PRIu64" full batches",
+            backend_names[r->backend], r->stats.calls, r->stats.datagrams, (double) r->stats.datagrams / r->stats.calls, r->batch, r->stats.full_batches);
+        rxconf_log(backend_names[r->backend], &r->sockets);
+        r->stats.reported = now;
+    }
+}
+
+// control messages of the k datagrams received last; the kernel shrinks control lengths to what it wrote,
+// they are restored for the next call
+static void receiver_control(receiver_t *r, source_t *source, int k) {
+    for (int i = 0; i < k; i++) {
+        rxconf_control(&r->msgs[i].msg_hdr, source, &r->sockets);
+        r->msgs[i].msg_hdr.msg_controllen = RXCONF_CONTROL_SIZE;
+    }
+}
+
+// receives datagrams queued in the socket of source and feeds them to its channel; with flags = 0 blocks
+// until the first datagram arrives, with MSG_DONTWAIT returns immediately
+// returns number of datagrams processed, -1 on error (errno is set)
+static int receive(receiver_t *r, source_t *source, int flags) {
+    // one datagram per recvmsg() call
+    if (r->backend == BACKEND_RECV) {
+        r->iov[0].iov_base = r->ring;
+        ssize_t size = recvmsg(source->socket, &r->msgs[0].msg_hdr, flags);
+        if (size == -1)
+            return -1;
+        receiver_control(r, source, 1);
+        process_channel_datagram(source->channel, r->ring, size, source->fec, monotonic_ns());
+        receiver_account(r, 1);
+        return 1;
+    }
+
+    // up to batch datagrams per recvmmsg() call
+    // MSG_WAITFORONE: block for the first datagram only, then take whatever is already queued
+    int n = recvmmsg(source->socket, r->msgs, r->batch, MSG_WAITFORONE | flags, NULL);
+    if (n == -1)
+        return -1;
+
+    receiver_control(r, source, n);
+    uint64_t now = monotonic_ns();
+    for (int i = 0; i < n; i++)
+        process_channel_datagram(source->channel, r->iov[i].iov_base, r->msgs[i].msg_len, source->fec, now);
+
+    receiver_account(r, n);
+    return n;
+}
+
+// receives straight into free slots of the channel's worker queue, the worker decodes them later
+// returns number of datagrams received, -1 on error (errno is set)
+static int receive_queued(receiver_t *r, source_t *source, int flags) {
+    worker_t *worker = source->channel->worker;
+
+    uint32_t n = spsc_free(&worker->input);
+    if (n == 0) {
+        // worker is behind; drop the datagram rather than stall the socket
+        ssize_t size = recv(source->socket, r->ring, MAX_DATAGRAM_SIZE, flags);
+        if (size == -1)
+            return -1;
+        if ((worker->dropped++ % 1000) == 0)
+            log_warn("Worker %u input queue full, %"PRIu64" datagrams dropped", worker->index, worker->dropped);
+        return 1;
+    }
+    if (n > r->batch) n = r->batch;
+    if (r->backend == BACKEND_RECV) n = 1;
+
+    datagram_slot_t *slot = spsc_producer_slot(&worker->input, 0);
+    int k = 1;
+    if (n == 1) {
+        r->iov[0].iov_base = slot->data;
+        ssize_t size = recvmsg(source->socket, &r->msgs[0].msg_hdr, flags);
+        if (size == -1)
+            return -1;
+        slot->length = size;
+        receiver_control(r, source, 1);
+        receiver_account(r, 1);
+    } else {
+        // iov are pointed at the queue slots instead of the ring
+        for (uint32_t i = 0; i < n; i++)
+            r->iov[i].iov_base = ((datagram_slot_t *) spsc_producer_slot(&worker->input, i))->data;
+
+        k = recvmmsg(source->socket, r->msgs, n, MSG_WAITFORONE | flags, NULL);
+        if (k == -1)
+            return -1;
+        for (int i = 0; i < k; i++)
+            ((datagram_slot_t *) spsc_producer_slot(&worker->input, i))->length = r->msgs[i].msg_len;
+        receiver_control(r, source, k);
+        receiver_account(r, k);
+    }
+
+    for (int i = 0; i < k; i++) {
+        slot = spsc_producer_slot(&worker->input, i);
+        slot->channel = source->channel;
+        slot->fec = source->fec;
+    }
+    spsc_produce(&worker->input, k);
+
+    return k;
+}
+
+// single socket, blocking reads
+static void receive_single(receiver_t *r, channel_t *channel) {
+    source_t source = { .channel = channel, .socket = channel->socket, .fec = NO };
+    expiry_add(&r->expiry, channel);
+    while (1) {
+        // datagrams held by the reorder window time out even if nothing arrives
+        int timeout = expiry_timeout(&r->expiry, -1);
+        if (timeout >= 0) {
+            int n = poll(&(struct pollfd) { .fd = channel->socket, .events = POLLIN }, 1, timeout);
+            if ((n == 0) || ((n == -1) && (errno == EINTR))) continue;
+            if (n == -1) err(1, "poll");
+        }
+        if (receive(r, &source, 0) == -1)
+            log_warn("recv: %s", strerror(errno));
+    }
+}
+
+// media socket and FEC sockets, if any, of every channel
+static source_t *channel_sources(channel_t *channels, int channel_count, int *source_count) {
+    source_t *sources = calloc(3 * channel_count, sizeof(source_t));
+    if (sources == NULL)
+        err(1, "calloc");
+    *source_count = 0;
+    for (int i = 0; i < channel_count; i++) {
+        sources[(*source_count)++] = (source_t) { .channel = &channels[i], .socket = channels[i].socket, .fec = NO };
+        for (int j = 0; (channels[i].fec != NULL) && (j < 2); j++)
+            sources[(*source_count)++] = (source_t) { .channel = &channels[i], .socket = channels[i].fec_sockets[j], .fec = YES };
+    }
+    return sources;
+}
+
+// many non-blocking sockets driven by one epoll instance
+static void receive_channels(receiver_t *r, source_t *sources, int source_count) {
+    int ep = epoll_create1(0);
+    if (ep == -1)
+        err(1, "epoll_create1");
+
+    for (int i = 0; i < source_count; i++) {
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = &sources[i] };
+        if (epoll_ctl(ep, EPOLL_CTL_ADD, sources[i].socket, &event) == -1)
+            err(1, "epoll_ctl");
+        if ((sources[i].fec == NO) && (sources[i].channel->worker == NULL))
+            expiry_add(&r->expiry, sources[i].channel);
+    }
+
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    while (1) {
+        // wake up in time for the output deadline and for datagrams held too long
+        int timeout = (r->output != NULL) ? output_timeout(r->output) : -1;
+        timeout = expiry_timeout(&r->expiry, timeout);
+        int n = epoll_wait(ep, events, MAX_EPOLL_EVENTS, timeout);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            err(1, "epoll_wait");
+        }
+
+        for (int i = 0; i < n; i++) {
+            source_t *source = events[i].data.ptr;
+
+            // level triggered: whatever is left after MAX_DRAIN_DATAGRAMS is reported again by the next epoll_wait()
+            int received = 0;
+            while (received < MAX_DRAIN_DATAGRAMS) {
+                int k = (source->channel->worker != NULL) ?
+                    receive_queued(r, source, MSG_DONTWAIT) :
+                    receive(r, source, MSG_DONTWAIT);
+                if (k == -1) {
+                    if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                        log_warn("%s: recv: %s", source->channel->name, strerror(errno));
+                    break;
+                }
+                received += k;
+            }
+        }
+
+        if (r->output != NULL)
+            output_poll(r->output);
+    }
+}
+
+// "[<source>@]<group>", source-specific multicast if a source is given; returns -1 if invalid
+static int parse_group(const char *s, in_addr_t *group, in_addr_t *source) {
+    char address[INET_ADDRSTRLEN];
+    const char *at = strchr(s, '@');
+    *source = INADDR_ANY;
+    if (at != NULL) {
+        snprintf(address, sizeof address, "%.*s", (int) (at - s), s);
+        if (inet_pton(AF_INET, address, source) != 1)
+            return -1;
+        s = at + 1;
+    }
+    return (inet_pton(AF_INET, s, group) == 1) ? 0 : -1;
+}
+
+// whole of s as a decimal number from min to max; returns -1 if it is not
+static int parse_number(const char *s, unsigned long min, unsigned long max, unsigned long *value) {
+    char *end;
+    if ((*s < '0') || (*s > '9'))
+        return -1;
+    errno = 0;
+    unsigned long v = strtoul(s, &end, 10);
+    if ((*end != '\0') || (errno != 0) || (v < min) || (v > max))
+        return -1;
+    *value = v;
+    return 0;
+}
+
+// teletext PID; "auto" = taken from PMT; returns -1 if invalid
+static int parse_pid(const char *s, uint16_t *pid) {
+    unsigned long v;
+    if (strcmp(s, "auto") == 0) {
+        *pid = PID_ANY;
+        return 0;
+    }
+    if (parse_number(s, 0, PID_NULL, &v) == -1)
+        return -1;
+    *pid = v;
+    return 0;
+}
+
+// dec to BCD, magazine pages numbers are in BCD (ETSI 300 706)
+static uint16_t page_to_bcd(uint16_t page) {
+    return ((page / 100) << 8) | (((page / 10) % 10) << 4) | (page % 10);
+}
+
+// reads channel list; every line is "<name> [<source>@]<group>:<port> [pcr:<pid>] <pid>:<page> [<pid>:<page> ...]",
+// <pid> can be "auto", <page> can be "all", # starts a comment
+static channel_t *read_channels(const char *path, uint64_t utc_refvalue, output_t *output, int *channel_count) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        err(1, "%s", path);
+
+    channel_t *channels = NULL;
+    int count = 0;
+    unsigned int line_number = 0;
+    char line[1024];
+
+    while (fgets(line, sizeof line, f) != NULL) {
+        line_number++;
+
+        char *comment = strchr(line, '#');
+        if (comment != NULL) *comment = '\0';
+
+        char *saveptr = NULL;
+        char *name = strtok_r(line, " \t\r\n", &saveptr);
+        if (name == NULL) continue;
+
+        char *group = strtok_r(NULL, " \t\r\n", &saveptr);
+        char *port = (group != NULL) ? strchr(group, ':') : NULL;
+        if (port == NULL)
+            errx(1, "%s:%u: [<source>@]<group>:<port> expected", path, line_number);
+        *port++ = '\0';
+
+        channels = realloc(channels, (count + 1) * sizeof(channel_t));
+        if (channels == NULL)
+            err(1, "realloc");
+        channel_t *channel = &channels[count++];
+        memset(channel, 0, sizeof(channel_t));
+
+        snprintf(channel->name, sizeof channel->name, "%s", name);
+        unsigned long v;
+        if ((parse_group(group, &channel->addr, &channel->source) == -1) || (parse_number(port, 1, 65535, &v) == -1))
+            errx(1, "%s:%u: invalid group %s:%s", path, line_number, group, port);
+        channel->port = v;
+
+        channel->dec = telx_new(utc_refvalue, output_page, output);
+        if (channel->dec == NULL)
+            err(1, "telx_new");
+
+        int subscriptions = 0;
+        for (char *t = strtok_r(NULL, " \t\r\n", &saveptr); t != NULL; t = strtok_r(NULL, " \t\r\n", &saveptr)) {
+            char *page = strchr(t, ':');
+            if (page == NULL)
+                errx(1, "%s:%u: <pid>:<page> expected, got %s", path, line_number, t);
+            *page++ = '\0';
+
+            if (strcmp(t, "pcr") == 0) {
+                if (parse_number(page, 0, PID_NULL, &v) == -1)
+                    errx(1, "%s:%u: invalid PCR PID %s", path, line_number, page);
+                telx_set_pcr_pid(channel->dec, v);
+                continue;
+            }
+
+            uint16_t pid;
+            if (parse_pid(t, &pid) == -1)
+                errx(1, "%s:%u: invalid PID %s", path, line_number, t);
+
+            // whole service; output lines start with channel name, page number is added by the decoder
+            if (strcmp(page, "all") == 0) {
+                if (telx_capture(channel->dec, pid, CACHE_PAGES, channel->name) == -1)
+                    errx(1, "%s:%u: unable to capture PID %s", path, line_number, t);
+                subscriptions++;
+                continue;
+            }
+
+            if (parse_number(page, 100, 899, &v) == -1)
+                errx(1, "%s:%u: invalid page %s, 100-899 expected", path, line_number, page);
+
+            // every output line starts with channel name and page number
+            char *tag = NULL;
+            if (asprintf(&tag, "%s\t%s", channel->name, page) == -1)
+                err(1, "asprintf");
+
+            if (telx_subscribe(channel->dec, pid, page_to_bcd(v), tag) == -1)
+                errx(1, "%s:%u: unable to subscribe page %s in PID %s", path, line_number, page, t);
+            subscriptions++;
+        }
+        if (subscriptions == 0)
+            errx(1, "%s:%u: no <pid>:<page> given for %s", path, line_number, channel->name);
+    }
+    fclose(f);
+
+    if (count == 0)
+        errx(1, "%s: no channels", path);
+
+    *channel_count = count;
+    return channels;
+}
+
+// flush policy "<pages>", "<ms>ms" or "<pages>,<ms>ms"
+static void parse_flush_policy(char *policy, unsigned int *flush_pages, unsigned int *flush_ms) {
+    for (char *t = strtok(policy, ","); t != NULL; t = strtok(NULL, ",")) {
+        char *end = NULL;
+        unsigned long v = strtoul(t, &end, 10);
+        if ((end == t) || (v == 0) || (v > 3600000))
+            errx(1, "invalid flush policy %s", t);
+        if (strcmp(end, "ms") == 0)
+            *flush_ms = v;
+        else if (*end == '\0')
+            *flush_pages = v;
+        else
+            errx(1, "invalid flush policy %s", t);
+    }
+}
+
+// receive buffer size in bytes, "k" and "M" suffixes are accepted
+static int parse_size(const char *s) {
+    char *end;
+    unsigned long size = strtoul(s, &end, 10);
+    if ((*end == 'k') || (*end == 'K')) size <<= 10;
+    else if (*end == 'M') size <<= 20;
+    else if (*end != '\0') size = 0;
+    if ((size == 0) || (size > INT_MAX / 2))
+        errx(1, "invalid receive buffer size %s", s);
+    return size;
+}
+
+// CPU list, or "local" to the NUMA node of interface
+static void parse_cpus(const char *list, const char *interface, cpu_set_t *cpus) {
+    if (rxconf_parse_cpus(list, interface, cpus) == 0)
+        return;
+    if (strcmp(list, "local") != 0)
+        errx(1, "invalid CPU list %s", list);
+    if (interface == NULL)
+        errx(1, "CPUs \"local\" need an interface (-i or -A)");
+    errx(1, "%s: NUMA node of the device unknown", interface);
+}
+
+static void usage(void) {
+    errx(1, "usage: teletext-ingest [-I backend] [-b batch] [-w workers] [-A interface] [-S] [-E] [-F flush] [-r pcr pid] [tuning] <pid|auto>[,<pid>...] <page>[,<page>...] [<source>@]<addr> <port>\n"
+            "       teletext-ingest [-I backend] [-b batch] [-w workers] [-A interface] [-S] [-E] [-F flush] [tuning] -c <channel list>\n"
+            "       teletext-ingest -f <file> [-P] [-S] [-E] [-F flush] [-r pcr pid] <pid|auto>[,<pid>...] <page>[,<page>...] [<addr> <port>]\n"
+            "       teletext-ingest -f <file> [-P] [-S] [-E] [-F flush] -c <channel list>\n"
+            "tuning: [-i interface] [-R rcvbuf] [-u busy poll] [-T] [-C cpus[:worker cpus]]");
+}
+
+int main(int argc, char *argv[]) {
+    char *pids[MAX_SUBSCRIPTIONS], *pages[MAX_SUBSCRIPTIONS];
+    int pid_count = 0, page_count = 0;
+    unsigned long batch = 1;
+    unsigned long workers = 0;
+    long pcr_pid = -1;
+    unsigned long v;
+    const char *channel_list = NULL;
+    const char *input = NULL;
+    const char *interface = NULL;
+    const char *backend_name = NULL;
+    const char *join_interface = NULL;
+    char *cpus = NULL;
+    uint8_t tuned = NO;
+    rxconf_t rxconf;
+    uint8_t paced = NO;
+    uint8_t dump_store = NO;
+    uint8_t fec = NO;
+    unsigned int flush_pages = 1, flush_ms = 0;
+    channel_t *channels = NULL;
+    int channel_count = 0;
+    int c;
+
+    rxconf_init(&rxconf);
+    while ((c = getopt(argc, argv, "A:b:c:C:Ef:F:i:I:Pr:R:STu:w:")) != -1) {
+        switch (c) {
+            case 'A':
+                interface = optarg;
+                break;
+            case 'I':
+                backend_name = optarg;
+                break;
+            case 'i':
+                join_interface = optarg;
+                tuned = YES;
+                break;
+            case 'R':
+                rxconf.rcvbuf = parse_size(optarg);
+                tuned = YES;
+                break;
+            case 'u':
+                if (parse_number(optarg, 0, INT_MAX, &v) == -1)
+                    errx(1, "invalid busy poll time %s", optarg);
+                rxconf.busy_poll = v;
+                tuned = YES;
+                break;
+            case 'T':
+                rxconf.timestamps = YES;
+                tuned = YES;
+                break;
+            case 'C':
+                cpus = optarg;
+                tuned = YES;
+                break;
+            case 'b':
+                if (parse_number(optarg, 1, MAX_RECV_BATCH, &v) == -1)
+                    errx(1, "batch size must be between 1 and %u", MAX_RECV_BATCH);
+                batch = v;
+                break;
+            case 'c':
+                channel_list = optarg;
+                break;
+            case 'E':
+                fec = YES;
+                break;
+            case 'f':
+                input = optarg;
+                break;
+            case 'F':
+                parse_flush_policy(optarg, &flush_pages, &flush_ms);
+                break;
+            case 'P':
+                paced = YES;
+                break;
+            case 'S':
+                dump_store = YES;
+                break;
+            case 'r':
+                if (parse_number(optarg, 0, PID_NULL, &v) == -1)
+                    errx(1, "PCR PID must be between 0 and %u", PID_NULL);
+                pcr_pid = v;
+                break;
+            case 'w':
+                if (parse_number(optarg, 1, MAX_WORKERS, &v) == -1)
+                    errx(1, "number of workers must be between 1 and %u", MAX_WORKERS);
+                workers = v;
+                break;
+            default:
+                usage();
+        }
+    }
+    argc -= optind;
+    argv += optind;
+
+    // file input is decoded by the reading thread
+    if (((input == NULL) && (paced == YES)) || ((input != NULL) && ((workers > 0) || (interface != NULL))))
+        usage();
+    if ((backend_name != NULL) && ((input != NULL) || (interface != NULL)))
+        usage();
+    if ((tuned == YES) && (input != NULL))
+        usage();
+
+    // groups are joined on the capture interface, unless told otherwise
+    if (join_interface == NULL)
+        join_interface = interface;
+    if ((join_interface != NULL) && (rxconf_interface(&rxconf, join_interface) == -1))
+        errx(1, "%s: no such interface with an IPv4 address", join_interface);
+
+    // "<receiving thread>[:<workers>]"
+    if (cpus != NULL) {
+        char *worker_cpus = strchr(cpus, ':');
+        if (worker_cpus != NULL) *worker_cpus++ = '\0';
+        parse_cpus(cpus, join_interface, &rxconf.receive_cpus);
+        if (worker_cpus != NULL)
+            parse_cpus(worker_cpus, join_interface, &rxconf.worker_cpus);
+    }
+
+    // recvmmsg() once a batch size is given
+    backend_t backend = (batch > 1) ? BACKEND_RECVMMSG : BACKEND_RECV;
+    if (backend_name != NULL) {
+        for (backend = 0; (backend <= BACKEND_URING) && (strcmp(backend_name, backend_names[backend]) != 0); backend++);
+        if (backend > BACKEND_URING)
+            errx(1, "unknown receive backend %s, expected recv, recvmmsg or io_uring", backend_name);
+    }
+    if (backend == BACKEND_RECV)
+        batch = 1;
+
+    // rendered pages are collected and written to stdout according to the flush policy
+    output_t *output = output_new(STDOUT_FILENO, flush_pages, flush_ms);
+    if (output == NULL)
+        err(1, "output_new");
+
+    if (channel_list != NULL) {
+        // channel list mode: one non-blocking socket and one decoder per channel
+        if ((argc != 0) || (pcr_pid != -1))
+            usage();
+
+        channels = read_channels(channel_list, (uint64_t) time(NULL), output, &channel_count);
+    } else {
+        // replayed files need no group, it only selects datagrams of a pcap file
+        if ((argc != 4) && ((input == NULL) || (argc != 2)))
+            usage();
+        // FEC datagrams are told from media ones by their port
+        if ((fec == YES) && (argc != 4))
+            usage();
+
+        // comma separated lists; a single PID is shared by all pages
+        for (char *t = strtok(argv[0], ","); t != NULL; t = strtok(NULL, ",")) {
+            if (pid_count == MAX_SUBSCRIPTIONS)
+                errx(1, "too many PIDs, at most %u are supported", MAX_SUBSCRIPTIONS);
+            pids[pid_count++] = t;
+        }
+        for (char *t = strtok(argv[1], ","); t != NULL; t = strtok(NULL, ",")) {
+            if (page_count == MAX_SUBSCRIPTIONS)
+                errx(1, "too many pages, at most %u are supported", MAX_SUBSCRIPTIONS);
+            pages[page_count++] = t;
+        }
+        if ((pid_count == 0) || (page_count == 0) || ((pid_count != 1) && (pid_count != page_count)))
+            errx(1, "either one PID, or one PID per page is expected");
+
+        channels = calloc(1, sizeof(channel_t));
+        if (channels == NULL)
+            err(1, "calloc");
+        channel_count = 1;
+        if (argc == 4) {
+            snprintf(channels[0].name, sizeof channels[0].name, "%s:%s", argv[2], argv[3]);
+            if (parse_group(argv[2], &channels[0].addr, &channels[0].source) == -1)
+                errx(1, "invalid group %s", argv[2]);
+            if (parse_number(argv[3], 1, 65535, &v) == -1)
+                errx(1, "invalid port %s", argv[3]);
+            channels[0].port = v;
+        } else {
+            snprintf(channels[0].name, sizeof channels[0].name, "%s", input);
+            channels[0].addr = INADDR_ANY;
+            channels[0].port = 0;
+        }
+
+        // Setup telxcc decoder
+        channels[0].dec = telx_new((uint64_t) time(NULL), output_page, output);
+        if (channels[0].dec == NULL)
+            err(1, "telx_new");
+        for (int i = 0; i < page_count; i++) {
+            uint16_t pid;
+            if (parse_pid(pids[(pid_count == 1) ? 0 : i], &pid) == -1)
+                errx(1, "invalid PID %s", pids[(pid_count == 1) ? 0 : i]);
+            // whole service, every output line starts with the page number
+            if (strcmp(pages[i], "all") == 0) {
+                if (telx_capture(channels[0].dec, pid, CACHE_PAGES, NULL) == -1)
+                    errx(1, "unable to capture PID %s", pids[(pid_count == 1) ? 0 : i]);
+                continue;
+            }
+            if (parse_number(pages[i], 100, 899, &v) == -1)
+                errx(1, "invalid page %s, 100-899 expected", pages[i]);
+            // with more than one page, every output line starts with the page number
+            if (telx_subscribe(channels[0].dec, pid, page_to_bcd(v), (page_count > 1) ? pages[i] : NULL) == -1)
+                errx(1, "unable to subscribe page %s in PID %s", pages[i], pids[(pid_count == 1) ? 0 : i]);
+        }
+        if (pcr_pid != -1)
+            telx_set_pcr_pid(channels[0].dec, pcr_pid);
+    }
+
+    // every page received by a channel, current content of the whole service
+    if (dump_store == YES) {
+        for (int i = 0; i < channel_count; i++) {
+            page_store_t *store = store_new(STORE_PAGES);
+            if (store == NULL)
+                err(1, "store_new");
+            telx_set_store(channels[i].dec, store);
+            channels[i].store_tag = (channel_list != NULL) ? channels[i].name : NULL;
+        }
+    }
+
+    // RTP datagrams are put back in sequence number order, lost ones recovered from FEC
+    if (fec == YES)
+        fec_channels(channels, channel_count);
+
+    if (input != NULL) {
+        replay_file(input, channels, channel_count, paced, output);
+        output_flush(output);
+        if (dump_store == YES) {
+            for (int i = 0; i < channel_count; i++)
+                store_dump(channels[i].dec->store, stdout, channels[i].store_tag);
+            fflush(stdout);
+        }
+        return 0;
+    }
+
+    // receiving never ends, page stores are dumped on request
+    if (dump_store == YES) {
+        struct sigaction action = { .sa_handler = request_store_dump, .sa_flags = SA_RESTART };
+        sigemptyset(&action.sa_mask);
+        if (sigaction(SIGUSR1, &action, NULL) == -1)
+            err(1, "sigaction");
+    }
+
+    // pipeline mode: channels are sharded over worker threads, a writer thread serializes output
+    if (workers > 0) {
+        pipeline_t *pipeline = pipeline_new(workers, output);
+        if (pipeline == NULL)
+            err(1, "pipeline_new");
+        for (int i = 0; i < channel_count; i++)
+            pipeline_attach(pipeline, &channels[i], i);
+        pipeline_start(pipeline, &rxconf.worker_cpus);
+        log_info("Decoding in %lu worker threads", workers);
+        if (CPU_COUNT(&rxconf.worker_cpus) > 0)
+            log_info("Worker threads pinned to %d CPUs", CPU_COUNT(&rxconf.worker_cpus));
+    }
+
+    // pinned after the pipeline threads are started, they would inherit it; receive buffers are allocated
+    // once pinned, on the NUMA node of the receiving thread
+    rxconf_pin(&rxconf.receive_cpus, "Receiving");
+    receiver_t receiver;
+    receiver_init(&receiver, (backend == BACKEND_URING) ? BACKEND_RECVMMSG : backend, batch, (workers > 0) ? NULL : output);
+
+    // AF_PACKET capture: groups are joined by sockets on an ephemeral port, which never receive a datagram
+    if (interface != NULL) {
+        for (int i = 0; i < channel_count; i++)
+            channels[i].socket = rxconf_socket(&rxconf, channels[i].addr, channels[i].source, 0, 1);
+        capture_channels(interface, channels, channel_count, (workers > 0) ? NULL : output);
+        return 0;
+    }
+
+    // Multicast receiver; the epoll loop also keeps the output deadline
+    int nonblocking = (channel_list != NULL) || (workers > 0) || (flush_ms > 0) || (fec == YES) || (backend == BACKEND_URING);
+    for (int i = 0; i < channel_count; i++) {
+        channel_t *channel = &channels[i];
+        channel->socket = rxconf_socket(&rxconf, channel->addr, channel->source, channel->port, nonblocking);
+        if (fec == YES) {
+            channel->fec_sockets[0] = rxconf_socket(&rxconf, channel->addr, channel->source, channel->port + FEC_COLUMN_PORT_OFFSET, nonblocking);
+            channel->fec_sockets[1] = rxconf_socket(&rxconf, channel->addr, channel->source, channel->port + FEC_ROW_PORT_OFFSET, nonblocking);
+        }
+    }
+
+    // reading input
+    if (nonblocking) {
+        int source_count;
+        source_t *sources = channel_sources(channels, channel_count, &source_count);
+        if ((backend == BACKEND_URING) && (uring_receive(sources, source_count, (workers > 0) ? NULL : output) == NO))
+            log_warn("io_uring not available, falling back to recvmmsg");
+        log_info("Receiving %d channels (%s)", channel_count, backend_names[receiver.backend]);
+        receive_channels(&receiver, sources, source_count);
+    } else {
+        receive_single(&receiver, &channels[0]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef INGEST_H_INCLUDED
+#define INGEST_H_INCLUDED
+
+#include <sys/types.h>
+#include <netinet/in.h>
+#include "rtp.h"
+#include "ts.h"
+#include "telxcc.h"
+
+// receive buffer size of a datagram: 7 TS packets, the usual maximum, plus RTP header with up to 15 CSRCs
+// and a header extension; longer datagrams are truncated
+#define MAX_DATAGRAM_SIZE 2048
+
+// maximum length of a channel name
+#define MAX_CHANNEL_NAME 32
+
+struct worker;
+struct reorder;
+struct fec;
+
+// one multicast group:port with its own decoder
+typedef struct {
+    char name[MAX_CHANNEL_NAME];
+    in_addr_t addr;
+    in_addr_t source; // source-specific multicast, INADDR_ANY = any source
+    uint16_t port;
+    int socket;
+    telx_decoder_t *dec;
+    struct worker *worker; // pipeline worker owning dec, NULL = decoded by the receiving thread
+    struct reorder *reorder; // RTP reorder window, used by the thread owning dec, set up by the first RTP datagram
+    struct fec *fec; // SMPTE 2022-1 recovery, used by the thread owning dec, NULL = FEC ignored
+    int fec_sockets[2]; // column (port + 2) and row (port + 4) FEC
+    const char *store_tag; // prefix of the lines of page store dumps, NULL = none
+    unsigned int store_dumps; // page store dumps requested by SIGUSR1 done so far
+} channel_t;
+
+// socket of a channel, media or FEC
+typedef struct {
+    channel_t *channel;
+    int socket;
+    uint8_t fec;
+    uint32_t drops; // SO_RXQ_OVFL counter seen last
+} source_t;
+
+// feeds every TS packet of a datagram to dec: RTP, or raw UDP if it starts with a sync byte
+void process_datagram(telx_decoder_t *dec, uint8_t *buffer, ssize_t size);
+// datagram of channel received at time now (in ns, CLOCK_MONOTONIC or capture time), passed on to
+// process_datagram() in RTP sequence number order; fec = YES for datagrams of the FEC streams
+void process_channel_datagram(channel_t *channel, uint8_t *buffer, ssize_t size, uint8_t fec, uint64_t now);
+// channel receiving datagrams sent to addr:port (INADDR_ANY and port 0 of a channel match any),
+// fec is set to YES for its FEC ports; NULL = none
+channel_t *find_channel(channel_t *channels, int channel_count, in_addr_t addr, uint16_t port, uint8_t *fec);
+// reorder windows and held back pages of the channels decoded by one thread, timed out on a timer too:
+// a stream going quiet would keep its held datagrams, and its last subtitle, otherwise
+typedef struct {
+    channel_t **channels;
+    int count;
+    uint64_t due; // next check (in ns)
+} expiry_t;
+
+// channel is decoded by the thread owning e
+void expiry_add(expiry_t *e, channel_t *channel);
+// gives up timed out missing datagrams and outputs pages held back too long of e's channels if due,
+// dumps their page stores if requested by SIGUSR1 meanwhile; returns timeout (in ms, -1 = none) of the caller's wait, shortened to the next check
+int expiry_timeout(expiry_t *e, int timeout);
+// CLOCK_MONOTONIC in ns
+uint64_t monotonic_ns(void);
+
+#endif
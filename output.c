@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "telxcc.h"
+#include "output.h"
+
+// writes iov completely, resuming after partial writes
+static void write_all(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            log_warn("Unable to write output: %s", strerror(errno));
+            return;
+        }
+
+        while ((count > 0) && ((size_t) n >= iov->iov_len)) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+output_t *output_new(int fd, unsigned int flush_pages, unsigned int flush_ms) {
+    output_t *out = calloc(1, sizeof(output_t));
+    if (out == NULL)
+        return NULL;
+
+    out->fd = fd;
+    out->flush_pages = (flush_pages > 0) ? flush_pages : 1;
+    out->flush_ms = flush_ms;
+    return out;
+}
+
+void output_flush(output_t *out) {
+    if (out->length > 0) {
+        struct iovec iov = { .iov_base = out->buffer, .iov_len = out->length };
+        write_all(out->fd, &iov, 1);
+    }
+    out->length = 0;
+    out->pages = 0;
+}
+
+void output_write(output_t *out, const char *data, size_t length, uint8_t complete) {
+    if (out->length + length > OUTPUT_WRITER_SIZE) {
+        // buffered pages and this data go out in one system call
+        struct iovec iov[2] = {
+            { .iov_base = out->buffer, .iov_len = out->length },
+            { .iov_base = (void *) data, .iov_len = length }
+        };
+        write_all(out->fd, iov, 2);
+        out->length = 0;
+        out->pages = 0;
+        return;
+    }
+
+    // the deadline starts running with the first buffered byte
+    if ((out->length == 0) && (out->flush_ms > 0)) {
+        clock_gettime(CLOCK_MONOTONIC, &out->deadline);
+        out->deadline.tv_sec += out->flush_ms / 1000;
+        out->deadline.tv_nsec += (out->flush_ms % 1000) * 1000000L;
+        if (out->deadline.tv_nsec >= 1000000000L) {
+            out->deadline.tv_sec++;
+            out->deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    memcpy(&out->buffer[out->length], data, length);
+    out->length += length;
+
+    if (complete == YES) {
+        out->pages++;
+        if (out->pages >= out->flush_pages)
+            output_flush(out);
+        else
+            output_poll(out);
+    }
+}
+
+void output_page(void *opaque, const char *data, size_t length) {
+    output_write(opaque, data, length, YES);
+}
+
+int output_timeout(const output_t *out) {
+    if ((out->length == 0) || (out->flush_ms == 0))
+        return -1;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t ms = (out->deadline.tv_sec - now.tv_sec) * 1000 + (out->deadline.tv_nsec - now.tv_nsec) / 1000000;
+    return (ms > 0) ? ms : 0;
+}
+
+void output_poll(output_t *out) {
+    if (output_timeout(out) == 0)
+        output_flush(out);
+}
@@ -0,0 +1,33 @@
+#ifndef OUTPUT_H_INCLUDED
+#define OUTPUT_H_INCLUDED
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <time.h>
+
+// size of the buffer pages are collected in before they are written out
+#define OUTPUT_WRITER_SIZE 65536
+
+// buffered writer of rendered pages; pages are written with one write() once the flush policy says so
+typedef struct {
+    int fd;
+    unsigned int flush_pages; // flush every flush_pages pages, 1 = every page
+    unsigned int flush_ms; // flush at the latest flush_ms after the first buffered page, 0 = no deadline
+    unsigned int pages; // complete pages in buffer
+    struct timespec deadline;
+    size_t length;
+    char buffer[OUTPUT_WRITER_SIZE];
+} output_t;
+
+output_t *output_new(int fd, unsigned int flush_pages, unsigned int flush_ms);
+// appends rendered data, complete = YES at the end of a page
+void output_write(output_t *out, const char *data, size_t length, uint8_t complete);
+// telx_output_cb_t writing a whole page into output_t opaque
+void output_page(void *opaque, const char *data, size_t length);
+// flushes if the deadline has passed
+void output_poll(output_t *out);
+// milliseconds until the deadline, -1 = nothing is waiting for one
+int output_timeout(const output_t *out);
+void output_flush(output_t *out);
+
+#endif
@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <err.h>
+#include "pipeline.h"
+
+// idle rounds spent in sched_yield() before a thread starts sleeping
+#define IDLE_SPIN_ROUNDS 64
+
+// sleep of an idle thread (in ns)
+#define IDLE_SLEEP 200000
+
+// waits for the other side of a queue; yields first, sleeps once idle for longer
+static void backoff(unsigned int *idle) {
+    if (*idle < IDLE_SPIN_ROUNDS) {
+        (*idle)++;
+        sched_yield();
+    } else {
+        nanosleep(&(struct timespec){ .tv_sec = 0, .tv_nsec = IDLE_SLEEP }, NULL);
+    }
+}
+
+// decoder output callback; queues rendered page for the writer, never drops it
+static void worker_output(void *opaque, const char *data, size_t length) {
+    worker_t *worker = opaque;
+    unsigned int idle = 0;
+
+    while (length > 0) {
+        while (spsc_free(&worker->output) == 0) backoff(&idle);
+
+        output_slot_t *slot = spsc_producer_slot(&worker->output, 0);
+        size_t n = (length > sizeof(slot->data)) ? sizeof(slot->data) : length;
+        memcpy(slot->data, data, n);
+        slot->length = n;
+        slot->more = (n < length) ? YES : NO;
+        spsc_produce(&worker->output, 1);
+
+        data += n;
+        length -= n;
+    }
+}
+
+static void *worker_main(void *arg) {
+    worker_t *worker = arg;
+    unsigned int idle = 0;
+
+    while (1) {
+        // datagrams held by reorder windows time out even if their streams went quiet; the worker never
+        // waits longer than IDLE_SLEEP, there is no timeout to shorten
+        expiry_timeout(&worker->expiry, -1);
+
+        uint32_t n = spsc_available(&worker->input);
+        if (n == 0) {
+            backoff(&idle);
+            continue;
+        }
+        idle = 0;
+
+        // reorder windows time out on the time of decoding
+        uint64_t now = monotonic_ns();
+        for (uint32_t i = 0; i < n; i++) {
+            datagram_slot_t *slot = spsc_consumer_slot(&worker->input, i);
+            process_channel_datagram(slot->channel, slot->data, slot->length, slot->fec, now);
+        }
+        spsc_consume(&worker->input, n);
+    }
+
+    return NULL;
+}
+
+// serializes output of all workers; a page is never interleaved with another one
+static void *writer_main(void *arg) {
+    pipeline_t *p = arg;
+    unsigned int idle = 0;
+
+    while (1) {
+        uint8_t written = NO;
+
+        for (unsigned int w = 0; w < p->worker_count; w++) {
+            spsc_queue_t *q = &p->workers[w].output;
+            uint8_t more = NO;
+
+            // drain this worker; if a page is split, stay here until its last chunk
+            do {
+                uint32_t n = spsc_available(q);
+                if (n == 0) {
+                    if (more == YES) backoff(&idle);
+                    continue;
+                }
+
+                for (uint32_t i = 0; i < n; i++) {
+                    output_slot_t *slot = spsc_consumer_slot(q, i);
+                    more = slot->more;
+                    output_write(p->output, slot->data, slot->length, (more == YES) ? NO : YES);
+                }
+                spsc_consume(q, n);
+                written = YES;
+            } while (more == YES);
+        }
+
+        if (written == YES) {
+            idle = 0;
+        } else {
+            output_poll(p->output);
+            backoff(&idle);
+        }
+    }
+
+    return NULL;
+}
+
+pipeline_t *pipeline_new(unsigned int worker_count, output_t *output) {
+    pipeline_t *p = calloc(1, sizeof(pipeline_t));
+    if (p == NULL)
+        return NULL;
+
+    // queue indexes are cache line aligned
+    if (posix_memalign((void **) &p->workers, 64, worker_count * sizeof(worker_t)) != 0) {
+        free(p);
+        return NULL;
+    }
+    memset(p->workers, 0, worker_count * sizeof(worker_t));
+    p->worker_count = worker_count;
+    p->output = output;
+
+    for (unsigned int i = 0; i < worker_count; i++) {
+        worker_t *worker = &p->workers[i];
+        worker->index = i;
+        if ((spsc_init(&worker->input, WORKER_QUEUE_SLOTS, sizeof(datagram_slot_t)) == -1) ||
+            (spsc_init(&worker->output, OUTPUT_QUEUE_SLOTS, sizeof(output_slot_t)) == -1)) {
+            // queues not set up are zeroed, freeing them does nothing
+            for (unsigned int j = 0; j <= i; j++) {
+                spsc_destroy(&p->workers[j].input);
+                spsc_destroy(&p->workers[j].output);
+            }
+            free(p->workers);
+            free(p);
+            return NULL;
+        }
+    }
+
+    return p;
+}
+
+void pipeline_attach(pipeline_t *p, channel_t *channel, unsigned int shard) {
+    channel->worker = &p->workers[shard % p->worker_count];
+    expiry_add(&channel->worker->expiry, channel);
+    telx_set_output(channel->dec, worker_output, channel->worker);
+}
+
+void pipeline_start(pipeline_t *p, const cpu_set_t *cpus) {
+    int cpu_count = CPU_COUNT(cpus);
+    int cpu = -1;
+
+    for (unsigned int i = 0; i < p->worker_count; i++) {
+        // one CPU per worker, round robin; the writer shares all of them
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (cpu_count > 0) {
+            cpu_set_t worker_cpu;
+            do cpu = (cpu + 1) % CPU_SETSIZE; while (!CPU_ISSET(cpu, cpus));
+            CPU_ZERO(&worker_cpu);
+            CPU_SET(cpu, &worker_cpu);
+            pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &worker_cpu);
+        }
+        int e = pthread_create(&p->workers[i].thread, &attr, worker_main, &p->workers[i]);
+        pthread_attr_destroy(&attr);
+        if (e != 0)
+            errx(1, "pthread_create: %s", strerror(e));
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (cpu_count > 0)
+        pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), cpus);
+    int e = pthread_create(&p->writer, &attr, writer_main, p);
+    pthread_attr_destroy(&attr);
+    if (e != 0)
+        errx(1, "pthread_create: %s", strerror(e));
+}
+
+uint8_t pipeline_queue(channel_t *channel, const uint8_t *datagram, size_t size, uint8_t fec) {
+    worker_t *worker = channel->worker;
+    if (spsc_free(&worker->input) == 0) {
+        if ((worker->dropped++ % 1000) == 0)
+            log_warn("Worker %u input queue full, %"PRIu64" datagrams dropped", worker->index, worker->dropped);
+        return NO;
+    }
+
+    datagram_slot_t *slot = spsc_producer_slot(&worker->input, 0);
+    if (size > sizeof(slot->data)) size = sizeof(slot->data);
+    slot->channel = channel;
+    slot->length = size;
+    slot->fec = fec;
+    memcpy(slot->data, datagram, size);
+    spsc_produce(&worker->input, 1);
+    return YES;
+}
@@ -0,0 +1,60 @@
+#ifndef PIPELINE_H_INCLUDED
+#define PIPELINE_H_INCLUDED
+
+#include <pthread.h>
+#include <sched.h>
+#include "spsc.h"
+#include "ingest.h"
+#include "output.h"
+
+// number of datagrams a worker can have queued
+#define WORKER_QUEUE_SLOTS 4096
+
+// number of output chunks a worker can have queued for the writer
+#define OUTPUT_QUEUE_SLOTS 1024
+
+// size of an output chunk; longer pages are split into consecutive chunks
+#define OUTPUT_SLOT_SIZE 2048
+
+// raw datagram, received in place by the receiver thread
+typedef struct {
+    channel_t *channel;
+    uint32_t length;
+    uint8_t fec; // YES = received from a FEC stream
+    uint8_t data[MAX_DATAGRAM_SIZE];
+} datagram_slot_t;
+
+// piece of rendered output
+typedef struct {
+    uint16_t length;
+    uint8_t more; // YES = page continues in the next slot
+    char data[OUTPUT_SLOT_SIZE - 4];
+} output_slot_t;
+
+// decoder thread; owns the decoders of all channels sharded to it
+typedef struct worker {
+    spsc_queue_t input; // datagrams, receiver -> worker
+    spsc_queue_t output; // rendered pages, worker -> writer
+    unsigned int index;
+    pthread_t thread;
+    uint64_t dropped; // datagrams dropped because input was full; maintained by the receiver
+    expiry_t expiry; // channels sharded to the worker
+} worker_t;
+
+// receiver -> workers -> writer
+typedef struct {
+    worker_t *workers;
+    unsigned int worker_count;
+    pthread_t writer;
+    output_t *output; // written by the writer thread only
+} pipeline_t;
+
+pipeline_t *pipeline_new(unsigned int worker_count, output_t *output);
+// hands channel's decoder over to worker shard % worker_count
+void pipeline_attach(pipeline_t *p, channel_t *channel, unsigned int shard);
+// starts worker and writer threads; workers are pinned to one of cpus each, unless empty
+void pipeline_start(pipeline_t *p, const cpu_set_t *cpus);
+// copies datagram into the input queue of the channel's worker; returns NO if dropped, the queue being full
+uint8_t pipeline_queue(channel_t *channel, const uint8_t *datagram, size_t size, uint8_t fec);
+
+#endif
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reorder.h"
+
+reorder_t *reorder_new(const char *name, unsigned int window, uint64_t timeout, reorder_deliver_cb_t deliver, void *opaque) {
+    unsigned int slots = 1;
+    while (slots < window) slots <<= 1;
+
+    reorder_t *r = calloc(1, sizeof(reorder_t) + slots * sizeof(reorder_slot_t));
+    if (r == NULL)
+        return NULL;
+
+    r->name = name;
+    r->window = slots;
+    r->timeout = timeout;
+    r->deliver = deliver;
+    r->opaque = opaque;
+    return r;
+}
+
+void reorder_free(reorder_t *r) {
+    free(r);
+}
+
+static void advance(reorder_t *r, uint8_t delivered) {
+    r->next++;
+    r->delivered = (r->delivered << 1) | delivered;
+}
+
+// delivers the next datagram if held, gives it up otherwise
+static void release_next(reorder_t *r) {
+    reorder_slot_t *slot = &r->slots[r->next & (r->window - 1)];
+    if (slot->length == 0) {
+        r->stats.lost++;
+        advance(r, NO);
+        return;
+    }
+
+    r->deliver(r->opaque, slot->data, slot->length);
+    slot->length = 0;
+    r->held--;
+    advance(r, YES);
+}
+
+// delivers held datagrams up to the next missing one
+static void drain(reorder_t *r) {
+    while ((r->held > 0) && (r->slots[r->next & (r->window - 1)].length > 0))
+        release_next(r);
+}
+
+void reorder_flush(reorder_t *r) {
+    while (r->held > 0)
+        release_next(r);
+}
+
+void reorder_push(reorder_t *r, uint8_t *datagram, size_t size, uint64_t now) {
+    // raw UDP starts with a sync byte, anything else not RTP is left to the decoder to complain about
+    if ((size < RTP_HEADER_SIZE) || (size > MAX_DATAGRAM_SIZE) || (datagram[0] == 0x47) || !rtp_check_hdr(datagram)) {
+        r->deliver(r->opaque, datagram, size);
+        return;
+    }
+
+    uint16_t seqnum = rtp_get_seqnum(datagram);
+    r->stats.received++;
+    if (r->started == NO) {
+        r->started = YES;
+        r->next = seqnum;
+        r->highest = seqnum;
+        r->stats.reported = now;
+    }
+
+    int16_t d = (int16_t) (seqnum - r->next);
+    if ((d <= -REORDER_RESET) || (d >= REORDER_RESET)) {
+        log_warn("%s: RTP sequence number jumped from %u to %u, restarting", r->name, r->next, seqnum);
+        reorder_flush(r);
+        r->next = seqnum;
+        r->highest = seqnum;
+        r->delivered = 0;
+        r->stats.resets++;
+        d = 0;
+    }
+
+    if (d < 0) {
+        // already delivered or given up
+        if ((-d <= 64) && ((r->delivered >> (-d - 1)) & 0x01)) r->stats.duplicates++;
+        else r->stats.late++;
+        return;
+    }
+
+    if (d > 0) {
+        // window is full: missing datagrams at its start are given up
+        for (; d >= (int) r->window; d--)
+            release_next(r);
+    }
+
+    reorder_slot_t *slot = &r->slots[seqnum & (r->window - 1)];
+    if ((d > 0) && (slot->length > 0)) {
+        r->stats.duplicates++;
+        return;
+    }
+    if ((int16_t) (seqnum - r->highest) < 0) {
+        r->stats.reordered++;
+    } else {
+        // sequence numbers skipped are missing from now on, each one is marked once
+        uint16_t s = ((int16_t) (r->highest - r->next) < 0) ? r->next : r->highest + 1;
+        for (; s != seqnum; s++)
+            r->slots[s & (r->window - 1)].missing = now;
+        r->highest = seqnum;
+    }
+
+    if (d == 0) {
+        // in order, the usual case; datagrams held behind it follow
+        r->deliver(r->opaque, datagram, size);
+        advance(r, YES);
+    } else {
+        slot->seqnum = seqnum;
+        slot->length = size;
+        slot->received = now;
+        memcpy(slot->data, datagram, size);
+        r->held++;
+    }
+    drain(r);
+
+    reorder_expire(r, now);
+
+    if (now >= r->stats.reported + REORDER_STATS_INTERVAL) {
+        reorder_log(r);
+        r->stats.reported = now;
+    }
+}
+
+uint8_t reorder_missing(const reorder_t *r, uint16_t seqnum) {
+    if (r->started == NO)
+        return YES;
+    int16_t d = (int16_t) (seqnum - r->next);
+    if (d < 0)
+        return NO;
+    if (d >= (int) r->window)
+        return YES;
+    const reorder_slot_t *slot = &r->slots[seqnum & (r->window - 1)];
+    return ((slot->length > 0) && (slot->seqnum == seqnum)) ? NO : YES;
+}
+
+uint64_t reorder_expire(reorder_t *r, uint64_t now) {
+    // waited long enough for the next missing datagram; released in sequence number order, only the head
+    // of the window is looked at
+    while ((r->held > 0) && (now > r->slots[r->next & (r->window - 1)].missing + r->timeout)) {
+        release_next(r);
+        drain(r);
+    }
+    return (r->held > 0) ? r->slots[r->next & (r->window - 1)].missing + r->timeout + 1 : UINT64_MAX;
+}
+
+void reorder_log(const reorder_t *r) {
+    log_info("%s: RTP %"PRIu64" datagrams, %"PRIu64" lost, %"PRIu64" reordered, %"PRIu64" duplicates, %"PRIu64" late, %"PRIu64" resets",
+        r->name, r->stats.received, r->stats.lost, r->stats.reordered, r->stats.duplicates, r->stats.late, r->stats.resets);
+}
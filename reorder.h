@@ -0,0 +1,81 @@
+#ifndef REORDER_H_INCLUDED
+#define REORDER_H_INCLUDED
+
+#include <stddef.h>
+#include <inttypes.h>
+#include "ingest.h"
+
+// datagrams held while waiting for a missing one, a power of two; about 65 ms of a 5 Mbit/s stream
+#define REORDER_WINDOW 32
+
+// longest wait for a missing datagram (in ns), 50 ms
+#define REORDER_TIMEOUT 50000000ULL
+
+// window and wait when a missing datagram may still be recovered by FEC: column FEC of a matrix
+// of up to 100 datagrams arrives while the next matrix is sent
+#define REORDER_FEC_WINDOW 256
+#define REORDER_FEC_TIMEOUT 1000000000ULL
+
+// sequence number jumps at least this large are taken as a restarted sender rather than loss or reordering
+#define REORDER_RESET 1024
+
+// how often held datagrams are checked for timeouts by the receive loops, whether datagrams arrive or not
+// (in ns), 10 ms
+#define REORDER_EXPIRY_INTERVAL 10000000ULL
+
+// how often statistics are logged (in ns), 60 s
+#define REORDER_STATS_INTERVAL 60000000000ULL
+
+// datagram received ahead of a missing one
+typedef struct {
+    uint16_t seqnum;
+    uint16_t length; // 0 = empty
+    uint64_t received; // at time (in ns)
+    uint64_t missing; // empty: found missing at time (in ns), when a higher sequence number was received
+    uint8_t data[MAX_DATAGRAM_SIZE];
+} reorder_slot_t;
+
+// called with datagrams in sequence number order
+typedef void (*reorder_deliver_cb_t)(void *opaque, uint8_t *datagram, size_t size);
+
+// RTP datagrams of one stream back in sequence number order; datagrams received in order are passed through
+// without copying, only those received ahead of a missing one are held in the preallocated window; a missing
+// datagram is given up once the window is full or the timeout has passed, checked as datagrams arrive and by reorder_expire()
+typedef struct reorder {
+    const char *name; // log prefix
+    reorder_deliver_cb_t deliver;
+    void *opaque;
+    unsigned int window; // slots, a power of two
+    uint64_t timeout; // in ns
+    uint8_t started;
+    uint16_t next; // sequence number delivered next
+    uint16_t highest; // highest sequence number received
+    uint64_t delivered; // bit i set = sequence number next - 1 - i was delivered, not given up
+    unsigned int held;
+    struct {
+        uint64_t received;
+        uint64_t lost; // given up
+        uint64_t reordered; // received after a higher sequence number, in time
+        uint64_t duplicates;
+        uint64_t late; // received after being given up
+        uint64_t resets;
+        uint64_t reported; // logged at time (in ns)
+    } stats;
+    reorder_slot_t slots[];
+} reorder_t;
+
+// window is rounded up to a power of two
+reorder_t *reorder_new(const char *name, unsigned int window, uint64_t timeout, reorder_deliver_cb_t deliver, void *opaque);
+void reorder_free(reorder_t *r);
+// datagram received at time now (in ns, any monotonic clock); other than RTP datagrams are passed through
+void reorder_push(reorder_t *r, uint8_t *datagram, size_t size, uint64_t now);
+// YES if the datagram of seqnum is still wanted: neither delivered, given up nor held
+uint8_t reorder_missing(const reorder_t *r, uint16_t seqnum);
+// gives up missing datagrams waited for long enough at time now, also when nothing arrives anymore; returns
+// the time (in ns) the next one is given up at, UINT64_MAX = nothing held
+uint64_t reorder_expire(reorder_t *r, uint64_t now);
+// delivers every datagram held, missing ones are given up
+void reorder_flush(reorder_t *r);
+void reorder_log(const reorder_t *r);
+
+#endif
@@ -0,0 +1,328 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <err.h>
+#include "replay.h"
+#include "reorder.h"
+#include "fec.h"
+
+// TS packets handed over to a decoder at once in the fast mode
+#define REPLAY_BURST 4096
+
+// TS packets checked for sync bytes during format detection
+#define DETECT_PACKETS 5
+
+// stream time jumps (in ns) larger than this re-anchor the pacing, 10 s
+#define PACE_MAX_GAP 10000000000ULL
+
+typedef enum {
+    FORMAT_UNKNOWN = 0,
+    FORMAT_TS,
+    FORMAT_M2TS,
+    FORMAT_PCAP
+} file_format_t;
+
+// maps stream time (PCR, capture time) onto the wall clock
+typedef struct {
+    uint8_t anchored;
+    uint64_t origin; // stream time of the anchor (in ns)
+    struct timespec wall; // wall clock of the anchor
+} pacer_t;
+
+typedef struct {
+    uint64_t ts_packets;
+    uint64_t datagrams;
+    uint64_t skipped; // datagrams not matching any channel, or not UDP
+    uint64_t resyncs;
+} replay_stats_t;
+
+// sleeps until stream time t is due
+static void pace(pacer_t *pacer, uint64_t t) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (pacer->anchored == YES) {
+        uint64_t elapsed = (now.tv_sec - pacer->wall.tv_sec) * 1000000000ULL + now.tv_nsec - pacer->wall.tv_nsec;
+        // stream time went back (wrap, new recording) or jumped far ahead
+        if ((t < pacer->origin) || (t - pacer->origin > elapsed + PACE_MAX_GAP))
+            pacer->anchored = NO;
+    }
+
+    if (pacer->anchored == NO) {
+        pacer->anchored = YES;
+        pacer->origin = t;
+        pacer->wall = now;
+        return;
+    }
+
+    uint64_t delta = t - pacer->origin;
+    struct timespec due = pacer->wall;
+    due.tv_sec += delta / 1000000000ULL;
+    due.tv_nsec += delta % 1000000000ULL;
+    if (due.tv_nsec >= 1000000000L) {
+        due.tv_sec++;
+        due.tv_nsec -= 1000000000L;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) != 0);
+}
+
+static uint8_t ts_stride_matches(const uint8_t *data, size_t size, size_t offset, size_t stride) {
+    for (size_t i = 0; i < DETECT_PACKETS; i++) {
+        size_t pos = offset + i * stride;
+        if (pos >= size)
+            return (i > 0) ? YES : NO;
+        if (!ts_validate(data + pos))
+            return NO;
+    }
+    return YES;
+}
+
+// returns format and position of the first TS sync byte, or of the first pcap record
+static file_format_t detect_format(const uint8_t *data, size_t size, size_t *offset) {
+    if (size >= 24) {
+        uint32_t magic = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+        if ((magic == 0xa1b2c3d4) || (magic == 0xd4c3b2a1) || (magic == 0xa1b23c4d) || (magic == 0x4d3cb2a1)) {
+            *offset = 24;
+            return FORMAT_PCAP;
+        }
+        if (magic == 0x0a0d0d0a)
+            errx(1, "pcapng is not supported, convert it to pcap first (editcap -F pcap)");
+    }
+
+    for (size_t i = 0; (i < TS_SIZE) && (i < size); i++) {
+        if (ts_stride_matches(data, size, i, TS_SIZE) == YES) {
+            *offset = i;
+            return FORMAT_TS;
+        }
+    }
+    // BDAV MPEG-2 TS: every packet is preceded by 4 bytes TP_extra_header
+    for (size_t i = 4; (i < TS_SIZE + 8) && (i < size); i++) {
+        if (ts_stride_matches(data, size, i, TS_SIZE + 4) == YES) {
+            *offset = i;
+            return FORMAT_M2TS;
+        }
+    }
+    return FORMAT_UNKNOWN;
+}
+
+// position of the next sync byte followed by another one a stride later
+static size_t resync(const uint8_t *data, size_t size, size_t pos, size_t stride) {
+    for (pos++; pos + TS_SIZE <= size; pos++) {
+        if (ts_validate(data + pos) && ((pos + stride >= size) || ts_validate(data + pos + stride)))
+            break;
+    }
+    return pos;
+}
+
+static void replay_ts(uint8_t *data, size_t size, size_t pos, size_t stride, channel_t *channels, int channel_count,
+        uint8_t paced, output_t *output, replay_stats_t *stats) {
+    pacer_t pacer = { 0 };
+    uint16_t pcr_pid = PID_ANY; // the first PID carrying PCR drives the pacing
+
+    while (pos + TS_SIZE <= size) {
+        uint8_t *ts_packet = data + pos;
+
+        if (!ts_validate(ts_packet)) {
+            pos = resync(data, size, pos, stride);
+            log_warn("TS sync lost, resynchronized at offset %zu", pos);
+            stats->resyncs++;
+            continue;
+        }
+
+        // fast mode: runs of packets in sync go to the decoders in one call
+        if ((paced == NO) && (stride == TS_SIZE)) {
+            unsigned int n = 1;
+            while ((n < REPLAY_BURST) && (pos + (n + 1) * TS_SIZE <= size) && ts_validate(ts_packet + n * TS_SIZE)) n++;
+            for (int c = 0; c < channel_count; c++)
+                telx_feed_ts_burst(channels[c].dec, ts_packet, n);
+            stats->ts_packets += n;
+            pos += n * TS_SIZE;
+            continue;
+        }
+
+        if ((paced == YES) && ts_has_adaptation(ts_packet) && (ts_get_adaptation(ts_packet) > 0) && tsaf_has_pcr(ts_packet)) {
+            if (pcr_pid == PID_ANY)
+                pcr_pid = ts_get_pid(ts_packet);
+            // PCR base runs at 90 kHz
+            if (ts_get_pid(ts_packet) == pcr_pid) {
+                pace(&pacer, tsaf_get_pcr(ts_packet) * 100000 / 9);
+                output_poll(output);
+            }
+        }
+
+        for (int c = 0; c < channel_count; c++)
+            telx_feed_ts(channels[c].dec, ts_packet);
+        stats->ts_packets++;
+        pos += stride;
+    }
+}
+
+static uint32_t pcap_u32(const uint8_t *p, uint8_t swapped) {
+    if (swapped == YES)
+        return (p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+    return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+uint8_t *frame_udp_payload(uint8_t *frame, size_t length, uint32_t linktype, in_addr_t *addr, uint16_t *port, size_t *size) {
+    size_t l = 0;
+    uint16_t ethertype = 0x0800;
+
+    switch (linktype) {
+        case 1: // Ethernet, optionally VLAN tagged
+            if (length < 14)
+                return NULL;
+            ethertype = (frame[12] << 8) | frame[13];
+            l = 14;
+            while (((ethertype == 0x8100) || (ethertype == 0x88a8)) && (length >= l + 4)) {
+                ethertype = (frame[l + 2] << 8) | frame[l + 3];
+                l += 4;
+            }
+            break;
+        case 113: // Linux cooked capture
+            if (length < 16)
+                return NULL;
+            ethertype = (frame[14] << 8) | frame[15];
+            l = 16;
+            break;
+        case 276: // Linux cooked capture v2
+            if (length < 20)
+                return NULL;
+            ethertype = (frame[0] << 8) | frame[1];
+            l = 20;
+            break;
+        case 101: // raw IP
+        case 228: // raw IPv4
+            break;
+        default:
+            errx(1, "unsupported pcap link type %u", linktype);
+    }
+
+    if ((ethertype != 0x0800) || (length < l + 20) || ((frame[l] >> 4) != 4) || (frame[l + 9] != 17))
+        return NULL;
+    // fragments are not reassembled
+    if ((((frame[l + 6] & 0x3f) << 8) | frame[l + 7]) != 0)
+        return NULL;
+
+    size_t u = l + (frame[l] & 0x0f) * 4;
+    if (length < u + 8)
+        return NULL;
+    size_t udp_length = (frame[u + 4] << 8) | frame[u + 5];
+    if ((udp_length < 8) || (u + udp_length > length))
+        return NULL;
+
+    memcpy(addr, &frame[l + 16], sizeof(in_addr_t));
+    *port = (frame[u + 2] << 8) | frame[u + 3];
+    *size = udp_length - 8;
+    return &frame[u + 8];
+}
+
+static void replay_pcap(uint8_t *data, size_t size, channel_t *channels, int channel_count, uint8_t paced, output_t *output,
+        replay_stats_t *stats) {
+    uint32_t magic = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+    uint8_t swapped = ((magic == 0xd4c3b2a1) || (magic == 0x4d3cb2a1)) ? YES : NO;
+    uint64_t fraction = ((magic == 0xa1b23c4d) || (magic == 0x4d3cb2a1)) ? 1 : 1000; // ns or us timestamps
+    uint32_t linktype = pcap_u32(&data[20], swapped) & 0xffff;
+    pacer_t pacer = { 0 };
+
+    for (size_t pos = 24; pos + 16 <= size; ) {
+        uint64_t t = pcap_u32(&data[pos], swapped) * 1000000000ULL + pcap_u32(&data[pos + 4], swapped) * fraction;
+        size_t length = pcap_u32(&data[pos + 8], swapped);
+        pos += 16;
+        if (pos + length > size) {
+            log_warn("Truncated pcap record at offset %zu", pos - 16);
+            break;
+        }
+
+        in_addr_t addr;
+        uint16_t port;
+        size_t datagram_size;
+        uint8_t *datagram = frame_udp_payload(&data[pos], length, linktype, &addr, &port, &datagram_size);
+        pos += length;
+
+        uint8_t fec = NO;
+        channel_t *channel = (datagram != NULL) ? find_channel(channels, channel_count, addr, port, &fec) : NULL;
+        if (channel == NULL) {
+            stats->skipped++;
+            continue;
+        }
+
+        if (paced == YES) {
+            pace(&pacer, t);
+            output_poll(output);
+        }
+        process_channel_datagram(channel, datagram, datagram_size, fec, t);
+        stats->datagrams++;
+    }
+}
+
+void replay_file(const char *path, channel_t *channels, int channel_count, uint8_t paced, output_t *output) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        err(1, "%s", path);
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        err(1, "%s", path);
+    if (st.st_size == 0)
+        errx(1, "%s: empty file", path);
+
+    // read-only mapping: decoders get pointers right into the file, nothing is copied or patched
+    uint8_t *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+        err(1, "%s: mmap", path);
+    close(fd);
+    // advice values are not flags, each one is given on its own; a failure only costs read-ahead
+    if (madvise(data, st.st_size, MADV_SEQUENTIAL) == -1)
+        log_warn("%s: madvise(MADV_SEQUENTIAL): %s", path, strerror(errno));
+    if (madvise(data, st.st_size, MADV_WILLNEED) == -1)
+        log_warn("%s: madvise(MADV_WILLNEED): %s", path, strerror(errno));
+
+    size_t offset = 0;
+    file_format_t format = detect_format(data, st.st_size, &offset);
+    replay_stats_t stats = { 0 };
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    switch (format) {
+        case FORMAT_TS:
+            log_info("%s: TS, %s replay", path, (paced == YES) ? "paced" : "fast");
+            replay_ts(data, st.st_size, offset, TS_SIZE, channels, channel_count, paced, output, &stats);
+            break;
+        case FORMAT_M2TS:
+            log_info("%s: M2TS, %s replay", path, (paced == YES) ? "paced" : "fast");
+            replay_ts(data, st.st_size, offset, TS_SIZE + 4, channels, channel_count, paced, output, &stats);
+            break;
+        case FORMAT_PCAP:
+            log_info("%s: pcap, %s replay", path, (paced == YES) ? "paced" : "fast");
+            replay_pcap(data, st.st_size, channels, channel_count, paced, output, &stats);
+            break;
+        default:
+            errx(1, "%s: unknown file format, TS, M2TS or pcap expected", path);
+    }
+
+    for (int c = 0; c < channel_count; c++) {
+        if ((format == FORMAT_PCAP) && (channels[c].reorder != NULL)) {
+            reorder_flush(channels[c].reorder);
+            reorder_log(channels[c].reorder);
+        }
+        if ((format == FORMAT_PCAP) && (channels[c].fec != NULL))
+            fec_log(channels[c].fec);
+        telx_flush(channels[c].dec);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    log_info("%s: %"PRIu64" TS packets, %"PRIu64" datagrams (%"PRIu64" skipped), %"PRIu64" resyncs in %.3f s (%.1f MB/s)",
+        path, stats.ts_packets, stats.datagrams, stats.skipped, stats.resyncs, seconds, st.st_size / seconds / 1e6);
+
+    munmap(data, st.st_size);
+}
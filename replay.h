@@ -0,0 +1,17 @@
+#ifndef REPLAY_H_INCLUDED
+#define REPLAY_H_INCLUDED
+
+#include "ingest.h"
+#include "output.h"
+
+// replays a recorded TS (188 B packets), M2TS (192 B packets) or pcap (RTP datagrams) file;
+// TS packets are fed to every channel, pcap datagrams to the channel of their group:port (INADDR_ANY = any),
+// paced = YES replays at the original rate (PCR, or capture time for pcap), NO as fast as possible;
+// output deadline is kept while pacing
+void replay_file(const char *path, channel_t *channels, int channel_count, uint8_t paced, output_t *output);
+
+// UDP payload of a captured frame of pcap link type linktype, with its destination addr and port;
+// returns NULL for anything else than unfragmented UDP over IPv4
+uint8_t *frame_udp_payload(uint8_t *frame, size_t length, uint32_t linktype, in_addr_t *addr, uint16_t *port, size_t *size);
+
+#endif
@@ -0,0 +1,230 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <arpa/inet.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#include <err.h>
+#include "rxconf.h"
+
+void rxconf_init(rxconf_t *conf) {
+    memset(conf, 0, sizeof(rxconf_t));
+    CPU_ZERO(&conf->receive_cpus);
+    CPU_ZERO(&conf->worker_cpus);
+}
+
+int rxconf_interface(rxconf_t *conf, const char *interface) {
+    conf->ifindex = if_nametoindex(interface);
+    if (conf->ifindex == 0)
+        return -1;
+
+    struct ifreq ifr = { 0 };
+    snprintf(ifr.ifr_name, sizeof ifr.ifr_name, "%s", interface);
+    ifr.ifr_addr.sa_family = AF_INET;
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s == -1)
+        return -1;
+    int e = ioctl(s, SIOCGIFADDR, &ifr);
+    close(s);
+    if (e == -1)
+        return -1;
+
+    conf->if_addr = ((struct sockaddr_in *) &ifr.ifr_addr)->sin_addr;
+    return 0;
+}
+
+int rxconf_parse_cpus(const char *list, const char *interface, cpu_set_t *cpus) {
+    char local[1024];
+    CPU_ZERO(cpus);
+
+    // CPUs sharing the NUMA node of the network device, as listed by sysfs
+    if (strcmp(list, "local") == 0) {
+        if (interface == NULL)
+            return -1;
+        char path[256];
+        snprintf(path, sizeof path, "/sys/class/net/%s/device/local_cpulist", interface);
+        FILE *f = fopen(path, "r");
+        if (f == NULL)
+            return -1;
+        char *line = fgets(local, sizeof local, f);
+        fclose(f);
+        if (line == NULL)
+            return -1;
+        list = local;
+    }
+
+    const char *p = list;
+    while (*p != '\0') {
+        char *end;
+        unsigned long first = strtoul(p, &end, 10), last = first;
+        if (end == p)
+            return -1;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtoul(p, &end, 10);
+            if ((end == p) || (last < first))
+                return -1;
+        }
+        if (last >= CPU_SETSIZE)
+            return -1;
+        for (unsigned long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, cpus);
+
+        p = end;
+        if (*p == ',') p++;
+        else if ((*p == '\n') || (*p == '\0')) break;
+        else return -1;
+    }
+    return (CPU_COUNT(cpus) > 0) ? 0 : -1;
+}
+
+void rxconf_pin(const cpu_set_t *cpus, const char *name) {
+    if (CPU_COUNT(cpus) == 0)
+        return;
+    int e = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), cpus);
+    if (e != 0)
+        errx(1, "pthread_setaffinity_np: %s", strerror(e));
+    log_info("%s thread pinned to %d CPUs", name, CPU_COUNT(cpus));
+}
+
+// SO_RCVBUF is capped by net.core.rmem_max, SO_RCVBUFFORCE is not but needs CAP_NET_ADMIN
+static void set_rcvbuf(int s, int size) {
+    static uint8_t warned = NO;
+
+    if (setsockopt(s, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) == -1)
+        err(1, "SO_RCVBUF");
+
+    // the kernel doubles the size asked for, for its bookkeeping overhead
+    int actual = 0;
+    socklen_t length = sizeof(actual);
+    if ((getsockopt(s, SOL_SOCKET, SO_RCVBUF, &actual, &length) == 0) && (actual >= 2 * size))
+        return;
+    if (setsockopt(s, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) == 0)
+        return;
+
+    if (warned == NO) {
+        log_warn("Receive buffer limited to %d bytes by net.core.rmem_max, SO_RCVBUFFORCE: %s", actual / 2, strerror(errno));
+        warned = YES;
+    }
+}
+
+int rxconf_socket(const rxconf_t *conf, in_addr_t group, in_addr_t source, uint16_t port, int nonblocking) {
+    int s, e;
+
+    s = socket(AF_INET, SOCK_DGRAM, PF_UNSPEC);
+    if (s == -1)
+        err(1, "socket");
+
+    int yes = 1, no = 0;
+    e = setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    if (e == -1)
+        err(1, "reuseaddr");
+
+    // datagrams of groups joined by other sockets bound to the same port are not received
+    e = setsockopt(s, IPPROTO_IP, IP_MULTICAST_ALL, &no, sizeof(no));
+    if (e == -1)
+        err(1, "IP_MULTICAST_ALL");
+
+    // kernel drop counter comes with every datagram received after a drop
+    e = setsockopt(s, SOL_SOCKET, SO_RXQ_OVFL, &yes, sizeof(yes));
+    if (e == -1)
+        err(1, "SO_RXQ_OVFL");
+
+    if (conf->rcvbuf > 0)
+        set_rcvbuf(s, conf->rcvbuf);
+
+    // values above net.core.busy_read need CAP_NET_ADMIN
+    static uint8_t busy_poll_warned = NO;
+    if ((conf->busy_poll > 0) && (setsockopt(s, SOL_SOCKET, SO_BUSY_POLL, &conf->busy_poll, sizeof(conf->busy_poll)) == -1) &&
+        (busy_poll_warned == NO)) {
+        log_warn("SO_BUSY_POLL: %s", strerror(errno));
+        busy_poll_warned = YES;
+    }
+
+    if (conf->timestamps == YES) {
+        int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+        e = setsockopt(s, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+        if (e == -1)
+            err(1, "SO_TIMESTAMPING");
+    }
+
+    // bound to the group, so that other groups sent to the same port are not received
+    struct sockaddr_in sin = { 0 };
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = group;
+    sin.sin_port = htons(port);
+
+    e = bind(s, (struct sockaddr *) &sin, sizeof sin);
+    if (e == -1)
+        err(1, "bind");
+
+    if (source != INADDR_ANY) {
+        // source-specific multicast (IGMPv3)
+        e = setsockopt(s, IPPROTO_IP, IP_ADD_SOURCE_MEMBERSHIP, (struct ip_mreq_source[]){{
+                .imr_multiaddr.s_addr = group,
+                .imr_interface = conf->if_addr,
+                .imr_sourceaddr.s_addr = source}}, sizeof(struct ip_mreq_source));
+        if (e == -1)
+            err(1, "IP_ADD_SOURCE_MEMBERSHIP");
+    } else {
+        e = setsockopt(s, IPPROTO_IP, IP_ADD_MEMBERSHIP, (struct ip_mreqn[]){{
+                .imr_multiaddr.s_addr = group,
+                .imr_ifindex = conf->ifindex}}, sizeof(struct ip_mreqn));
+        if (e == -1)
+            err(1, "IP_ADD_MEMBERSHIP");
+    }
+
+    if (nonblocking) {
+        e = fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+        if (e == -1)
+            err(1, "fcntl");
+    }
+
+    return s;
+}
+
+void rxconf_control(const struct msghdr *msg, source_t *source, rxconf_stats_t *stats) {
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR((struct msghdr *) msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET) continue;
+
+        if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+            // counts every datagram the socket dropped so far
+            uint32_t drops;
+            memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+            stats->drops += (uint32_t) (drops - source->drops);
+            source->drops = drops;
+        } else if (cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            // software receive timestamp, CLOCK_REALTIME
+            struct scm_timestamping ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            int64_t latency = (now.tv_sec - ts.ts[0].tv_sec) * 1000000000LL + (now.tv_nsec - ts.ts[0].tv_nsec);
+            if (latency < 0) latency = 0;
+
+            stats->latency_count++;
+            stats->latency_sum += latency;
+            if ((uint64_t) latency > stats->latency_max) stats->latency_max = latency;
+        }
+    }
+}
+
+void rxconf_log(const char *name, rxconf_stats_t *stats) {
+    if (stats->latency_count > 0) {
+        log_info("%s: %"PRIu64" datagrams dropped by the kernel, receive delay %.1f us average, %.1f us max",
+            name, stats->drops, stats->latency_sum / 1000.0 / stats->latency_count, stats->latency_max / 1000.0);
+    } else {
+        log_info("%s: %"PRIu64" datagrams dropped by the kernel", name, stats->drops);
+    }
+    stats->latency_count = 0;
+    stats->latency_sum = 0;
+    stats->latency_max = 0;
+}
@@ -0,0 +1,48 @@
+#ifndef RXCONF_H_INCLUDED
+#define RXCONF_H_INCLUDED
+
+#include <sched.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "ingest.h"
+
+// space for the control messages taken with every datagram: SO_RXQ_OVFL drop counter, SO_TIMESTAMPING
+#define RXCONF_CONTROL_SIZE (CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(3 * sizeof(struct timespec)))
+
+// receive configuration of the multicast sockets and of the threads reading and decoding them
+typedef struct {
+    unsigned int ifindex; // groups are joined on this interface, 0 = chosen by the routing table
+    struct in_addr if_addr; // its address, source-specific joins name the interface by address
+    int rcvbuf; // SO_RCVBUF (in bytes), 0 = system default
+    int busy_poll; // SO_BUSY_POLL (in us), 0 = off
+    uint8_t timestamps; // YES = SO_TIMESTAMPING, delay from kernel receive to user space is logged
+    cpu_set_t receive_cpus; // affinity of the receiving thread, empty = not pinned
+    cpu_set_t worker_cpus; // pipeline workers are pinned round robin, empty = not pinned
+} rxconf_t;
+
+// socket statistics of every source served by one thread, taken from control messages
+typedef struct {
+    uint64_t drops; // datagrams dropped by the kernel, socket receive buffer full
+    uint64_t latency_count; // datagrams timestamped since logged last
+    uint64_t latency_sum; // in ns
+    uint64_t latency_max; // in ns
+} rxconf_stats_t;
+
+// nothing configured
+void rxconf_init(rxconf_t *conf);
+// joins groups on interface; returns -1 if it does not exist or has no IPv4 address
+int rxconf_interface(rxconf_t *conf, const char *interface);
+// parses a CPU list like "0-3,8"; "local" stands for the CPUs of the NUMA node of interface's device
+// returns -1 on error
+int rxconf_parse_cpus(const char *list, const char *interface, cpu_set_t *cpus);
+// pins the calling thread to cpus, unless empty
+void rxconf_pin(const cpu_set_t *cpus, const char *name);
+// multicast receiver socket bound to group:port and joined to group, from source only unless it is INADDR_ANY
+int rxconf_socket(const rxconf_t *conf, in_addr_t group, in_addr_t source, uint16_t port, int nonblocking);
+// control messages of msg received by the socket of source
+void rxconf_control(const struct msghdr *msg, source_t *source, rxconf_stats_t *stats);
+// logs drops and delay with prefix name, the delay is reset
+void rxconf_log(const char *name, rxconf_stats_t *stats);
+
+#endif
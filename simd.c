@@ -0,0 +1,128 @@
+#include <string.h>
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86
+#endif
+
+// reverses bits of every byte of a 64 bit word
+static inline uint64_t reverse_bytes_64(uint64_t x) {
+    x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    return ((x >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((x & 0x0f0f0f0f0f0f0f0fULL) << 4);
+}
+
+static void reverse_unit_scalar(uint8_t *unit) {
+    for (uint8_t i = 0; i < 40; i += 8) {
+        uint64_t x;
+        memcpy(&x, unit + i, 8);
+        x = reverse_bytes_64(x);
+        memcpy(unit + i, &x, 8);
+    }
+    uint32_t x;
+    memcpy(&x, unit + 40, 4);
+    x = reverse_bytes_64(x);
+    memcpy(unit + 40, &x, 4);
+}
+
+static void row_bitmaps_scalar(const uint16_t *row, uint64_t *printable, uint64_t *start_box, uint64_t *end_box) {
+    *printable = 0;
+    *start_box = 0;
+    *end_box = 0;
+    for (uint8_t i = 0; i < 40; i++) {
+        if (row[i] > 0x20) *printable |= 1ULL << i;
+        else if (row[i] == 0x0b) *start_box |= 1ULL << i;
+        else if (row[i] == 0x0a) *end_box |= 1ULL << i;
+    }
+}
+
+static const kernels_t KERNELS_SCALAR = { "scalar", reverse_unit_scalar, row_bitmaps_scalar };
+
+#ifdef SIMD_X86
+// nibble lookup tables for pshufb, repeated for both AVX2 lanes
+static const uint8_t NIBBLE_REVERSED_HIGH[32] __attribute__((aligned(32))) = {
+    0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0, 0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
+    0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0, 0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0
+};
+
+static const uint8_t NIBBLE_REVERSED_LOW[32] __attribute__((aligned(32))) = {
+    0x00, 0x08, 0x04, 0x0c, 0x02, 0x0a, 0x06, 0x0e, 0x01, 0x09, 0x05, 0x0d, 0x03, 0x0b, 0x07, 0x0f,
+    0x00, 0x08, 0x04, 0x0c, 0x02, 0x0a, 0x06, 0x0e, 0x01, 0x09, 0x05, 0x0d, 0x03, 0x0b, 0x07, 0x0f
+};
+
+__attribute__((target("ssse3"))) static inline __m128i reverse_ssse3(__m128i v) {
+    const __m128i high = _mm_load_si128((const __m128i *) NIBBLE_REVERSED_HIGH);
+    const __m128i low = _mm_load_si128((const __m128i *) NIBBLE_REVERSED_LOW);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    return _mm_or_si128(_mm_shuffle_epi8(high, _mm_and_si128(v, nibble)),
+        _mm_shuffle_epi8(low, _mm_and_si128(_mm_srli_epi16(v, 4), nibble)));
+}
+
+// bytes 0-15, 16-31 and 28-43; all loads precede the stores, so the overlap is rewritten with equal values
+__attribute__((target("ssse3"))) static void reverse_unit_ssse3(uint8_t *unit) {
+    __m128i a = _mm_loadu_si128((const __m128i *) unit);
+    __m128i b = _mm_loadu_si128((const __m128i *) (unit + 16));
+    __m128i c = _mm_loadu_si128((const __m128i *) (unit + 28));
+    _mm_storeu_si128((__m128i *) unit, reverse_ssse3(a));
+    _mm_storeu_si128((__m128i *) (unit + 16), reverse_ssse3(b));
+    _mm_storeu_si128((__m128i *) (unit + 28), reverse_ssse3(c));
+}
+
+// 16 characters, a and b, into 16 bits of every bitmap; characters are unsigned, so they are biased for the signed compare
+__attribute__((target("sse2"))) static inline void row_bitmaps_16(__m128i a, __m128i b, uint8_t shift, uint64_t *printable, uint64_t *start_box, uint64_t *end_box) {
+    const __m128i bias = _mm_set1_epi16(-0x8000);
+    const __m128i space = _mm_set1_epi16(0x20 - 0x8000);
+    const __m128i start = _mm_set1_epi16(0x0b);
+    const __m128i end = _mm_set1_epi16(0x0a);
+    __m128i above_a = _mm_cmpgt_epi16(_mm_xor_si128(a, bias), space);
+    __m128i above_b = _mm_cmpgt_epi16(_mm_xor_si128(b, bias), space);
+    *printable |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_packs_epi16(above_a, above_b)) << shift;
+    *start_box |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_packs_epi16(_mm_cmpeq_epi16(a, start), _mm_cmpeq_epi16(b, start))) << shift;
+    *end_box |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_packs_epi16(_mm_cmpeq_epi16(a, end), _mm_cmpeq_epi16(b, end))) << shift;
+}
+
+// characters 0-15, 16-31 and 32-39 (padded with zeros)
+__attribute__((target("sse2"))) static void row_bitmaps_sse2(const uint16_t *row, uint64_t *printable, uint64_t *start_box, uint64_t *end_box) {
+    *printable = 0;
+    *start_box = 0;
+    *end_box = 0;
+    row_bitmaps_16(_mm_loadu_si128((const __m128i *) row), _mm_loadu_si128((const __m128i *) (row + 8)), 0, printable, start_box, end_box);
+    row_bitmaps_16(_mm_loadu_si128((const __m128i *) (row + 16)), _mm_loadu_si128((const __m128i *) (row + 24)), 16, printable, start_box, end_box);
+    row_bitmaps_16(_mm_loadu_si128((const __m128i *) (row + 32)), _mm_setzero_si128(), 32, printable, start_box, end_box);
+}
+
+static const kernels_t KERNELS_SSSE3 = { "ssse3", reverse_unit_ssse3, row_bitmaps_sse2 };
+
+__attribute__((target("avx2"))) static inline __m256i reverse_avx2(__m256i v) {
+    const __m256i high = _mm256_load_si256((const __m256i *) NIBBLE_REVERSED_HIGH);
+    const __m256i low = _mm256_load_si256((const __m256i *) NIBBLE_REVERSED_LOW);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    return _mm256_or_si256(_mm256_shuffle_epi8(high, _mm256_and_si256(v, nibble)),
+        _mm256_shuffle_epi8(low, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)));
+}
+
+// bytes 0-31 and 12-43
+__attribute__((target("avx2"))) static void reverse_unit_avx2(uint8_t *unit) {
+    __m256i a = _mm256_loadu_si256((const __m256i *) unit);
+    __m256i b = _mm256_loadu_si256((const __m256i *) (unit + 12));
+    _mm256_storeu_si256((__m256i *) unit, reverse_avx2(a));
+    _mm256_storeu_si256((__m256i *) (unit + 12), reverse_avx2(b));
+}
+
+// 40 characters are too few for 256 bit wide compares to pay off
+static const kernels_t KERNELS_AVX2 = { "avx2", reverse_unit_avx2, row_bitmaps_sse2 };
+#endif
+
+const kernels_t *KERNELS[3] = { &KERNELS_SCALAR };
+unsigned int KERNEL_COUNT = 1;
+const kernels_t *kernels = &KERNELS_SCALAR;
+
+__attribute__((constructor)) static void init_kernels(void) {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3")) KERNELS[KERNEL_COUNT++] = &KERNELS_SSSE3;
+    if (__builtin_cpu_supports("avx2")) KERNELS[KERNEL_COUNT++] = &KERNELS_AVX2;
+#endif
+    kernels = KERNELS[KERNEL_COUNT - 1];
+}
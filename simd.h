@@ -0,0 +1,24 @@
+#ifndef SIMD_H_INCLUDED
+#define SIMD_H_INCLUDED
+
+#include <inttypes.h>
+
+// bulk kernels working on a whole teletext data unit or row at once; characters of rows 1-23 are decoded
+// by decode_row() in telxcc.c instead: its one REVERSE_PARITY_G0_LATIN lookup per character reverses, checks
+// parity and maps through G0 at once, which beats reversing and stripping parity in vectors before the G0 lookup
+typedef struct {
+    const char *name;
+    // reverses bit order of every byte of a 44 bytes long data unit in place, ETS 300 706, chapter 7.1
+    void (*reverse_unit)(uint8_t *unit);
+    // column bitmaps of a row of 40 characters: above space, start box (0x0b) and end box (0x0a)
+    void (*row_bitmaps)(const uint16_t *row, uint64_t *printable, uint64_t *start_box, uint64_t *end_box);
+} kernels_t;
+
+// every implementation supported by the running CPU, the fastest one last
+extern const kernels_t *KERNELS[];
+extern unsigned int KERNEL_COUNT;
+
+// implementation in use, chosen at start-up
+extern const kernels_t *kernels;
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef SPSC_H_INCLUDED
+#define SPSC_H_INCLUDED
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Lock-free single-producer/single-consumer ring of fixed size slots.
+// The producer owns head, the consumer owns tail; each index lives on its own cache line.
+// Slots are filled in place: the producer writes into spsc_producer_slot() and publishes
+// with spsc_produce(), the consumer reads spsc_consumer_slot() and releases with spsc_consume().
+typedef struct {
+    uint8_t *slots;
+    uint32_t slot_size;
+    uint32_t mask; // slot count - 1; slot count is a power of two
+    uint32_t head __attribute__((aligned(64))); // next slot to be produced
+    uint32_t tail __attribute__((aligned(64))); // next slot to be consumed
+} __attribute__((aligned(64))) spsc_queue_t;
+
+// slot_count is rounded up to a power of two; returns -1 if allocation fails
+static inline int spsc_init(spsc_queue_t *q, uint32_t slot_count, uint32_t slot_size) {
+    uint32_t n = 1;
+    while (n < slot_count) n <<= 1;
+
+    q->slots = calloc(n, slot_size);
+    if (q->slots == NULL)
+        return -1;
+    q->slot_size = slot_size;
+    q->mask = n - 1;
+    q->head = 0;
+    q->tail = 0;
+    return 0;
+}
+
+static inline void spsc_destroy(spsc_queue_t *q) {
+    free(q->slots);
+    q->slots = NULL;
+}
+
+// producer side: number of slots that can be filled right now
+static inline uint32_t spsc_free(const spsc_queue_t *q) {
+    uint32_t tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    return q->mask + 1 - (q->head - tail);
+}
+
+// producer side: i-th free slot, i < spsc_free()
+static inline void *spsc_producer_slot(spsc_queue_t *q, uint32_t i) {
+    return q->slots + (size_t)((q->head + i) & q->mask) * q->slot_size;
+}
+
+// producer side: publishes n filled slots
+static inline void spsc_produce(spsc_queue_t *q, uint32_t n) {
+    __atomic_store_n(&q->head, q->head + n, __ATOMIC_RELEASE);
+}
+
+// consumer side: number of slots ready to be consumed
+static inline uint32_t spsc_available(const spsc_queue_t *q) {
+    return __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) - q->tail;
+}
+
+// consumer side: i-th ready slot, i < spsc_available()
+static inline void *spsc_consumer_slot(spsc_queue_t *q, uint32_t i) {
+    return q->slots + (size_t)((q->tail + i) & q->mask) * q->slot_size;
+}
+
+// consumer side: gives n slots back to the producer
+static inline void spsc_consume(spsc_queue_t *q, uint32_t n) {
+    __atomic_store_n(&q->tail, q->tail + n, __ATOMIC_RELEASE);
+}
+
+#endif
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "telxcc.h"
+#include "store.h"
+
+#define STORE_KEY(page, subpage) (((uint32_t) (page) << 16) | (subpage))
+
+static uint32_t store_bucket(const page_store_t *store, uint32_t key) {
+    uint32_t h = key * 0x9e3779b1;
+    return (h ^ (h >> 16)) & store->bucket_mask;
+}
+
+page_store_t *store_new(uint32_t capacity) {
+    if (capacity == 0)
+        return NULL;
+
+    page_store_t *store = calloc(1, sizeof(page_store_t));
+    if (store == NULL)
+        return NULL;
+
+    // at least one bucket per page
+    uint32_t buckets = 1;
+    while (buckets < capacity) buckets <<= 1;
+
+    store->pool = calloc(capacity, sizeof(store_page_t));
+    store->buckets = calloc(buckets, sizeof(uint32_t));
+    if ((store->pool == NULL) || (store->buckets == NULL)) {
+        store_free(store);
+        return NULL;
+    }
+    store->capacity = capacity;
+    store->bucket_mask = buckets - 1;
+    return store;
+}
+
+void store_free(page_store_t *store) {
+    if (store == NULL)
+        return;
+
+    free(store->pool);
+    free(store->buckets);
+    free(store);
+}
+
+static store_page_t *store_find(const page_store_t *store, uint16_t page, uint16_t subpage) {
+    uint32_t key = STORE_KEY(page, subpage);
+    for (uint32_t i = store->buckets[store_bucket(store, key)]; i > 0; i = store->pool[i - 1].chain) {
+        store_page_t *p = &store->pool[i - 1];
+        if (STORE_KEY(p->page, p->subpage) == key) return p;
+    }
+    return NULL;
+}
+
+const store_page_t *store_lookup(const page_store_t *store, uint16_t page, uint16_t subpage) {
+    return store_find(store, page, subpage);
+}
+
+static void unlink_bucket(page_store_t *store, store_page_t *p) {
+    uint32_t index = p - store->pool + 1;
+    uint32_t *link = &store->buckets[store_bucket(store, STORE_KEY(p->page, p->subpage))];
+    while (*link != index) link = &store->pool[*link - 1].chain;
+    *link = p->chain;
+}
+
+static void unlink_change(page_store_t *store, store_page_t *p) {
+    if (p->prev != NULL) p->prev->next = p->next;
+    else store->oldest = p->next;
+    if (p->next != NULL) p->next->prev = p->prev;
+    else store->newest = p->prev;
+    p->prev = NULL;
+    p->next = NULL;
+}
+
+static void append_change(page_store_t *store, store_page_t *p) {
+    p->prev = store->newest;
+    p->next = NULL;
+    if (store->newest != NULL) store->newest->next = p;
+    else store->oldest = p;
+    store->newest = p;
+}
+
+static void unlink_received(page_store_t *store, store_page_t *p) {
+    if (p->received_prev != NULL) p->received_prev->received_next = p->received_next;
+    else store->least_received = p->received_next;
+    if (p->received_next != NULL) p->received_next->received_prev = p->received_prev;
+    else store->most_received = p->received_prev;
+    p->received_prev = NULL;
+    p->received_next = NULL;
+}
+
+static void append_received(page_store_t *store, store_page_t *p) {
+    p->received_prev = store->most_received;
+    p->received_next = NULL;
+    if (store->most_received != NULL) store->most_received->received_next = p;
+    else store->least_received = p;
+    store->most_received = p;
+}
+
+void store_update(page_store_t *store, uint16_t page, uint16_t subpage, const uint16_t text[25][40], uint32_t rows, uint64_t timestamp) {
+    store_page_t *p = store_find(store, page, subpage);
+
+    if (p == NULL) {
+        if (store->count < store->capacity) {
+            p = &store->pool[store->count++];
+        } else {
+            p = store->least_received;
+            unlink_bucket(store, p);
+            unlink_change(store, p);
+            unlink_received(store, p);
+            store->evicted++;
+        }
+
+        memset(p, 0, sizeof(store_page_t));
+        p->page = page;
+        p->subpage = subpage;
+        p->created = timestamp;
+
+        uint32_t bucket = store_bucket(store, STORE_KEY(page, subpage));
+        p->chain = store->buckets[bucket];
+        store->buckets[bucket] = p - store->pool + 1;
+        append_change(store, p);
+        append_received(store, p);
+    }
+
+    uint8_t changed = (p->version == 0) ? YES : NO;
+    for (uint8_t y = 0; y < 25; y++) {
+        if ((rows >> y) & 0x01) {
+            if (memcmp(p->text[y], text[y], sizeof(p->text[y])) == 0) continue;
+            memcpy(p->text[y], text[y], sizeof(p->text[y]));
+            changed = YES;
+        } else if ((p->rows >> y) & 0x01) {
+            memset(p->text[y], 0x00, sizeof(p->text[y]));
+            changed = YES;
+        }
+    }
+    p->rows = rows;
+    p->received = timestamp;
+    if (p != store->most_received) {
+        unlink_received(store, p);
+        append_received(store, p);
+    }
+
+    if (changed == YES) {
+        p->version++;
+        p->updated = timestamp;
+        unlink_change(store, p);
+        append_change(store, p);
+    }
+}
+
+void store_changed_since(const page_store_t *store, uint64_t t, store_visit_cb_t visit, void *opaque) {
+    for (const store_page_t *p = store->newest; (p != NULL) && (p->updated > t); p = p->prev) {
+        if (visit(opaque, p) == NO) break;
+    }
+}
+
+void store_dump(const page_store_t *store, FILE *f, const char *tag) {
+    for (const store_page_t *p = store->oldest; p != NULL; p = p->next) {
+        if (tag != NULL) fprintf(f, "%s\t", tag);
+        fprintf(f, "%03x\t%04x\t%"PRIu32"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64, p->page, p->subpage, p->version,
+            p->created, p->updated, p->received);
+
+        for (uint8_t y = 0; y < 25; y++) {
+            if (((p->rows >> y) & 0x01) == 0) continue;
+
+            // trimmed, spacing attributes and other control codes are displayed as spaces
+            int8_t first = 0, last = 39;
+            while ((first <= last) && (p->text[y][first] <= 0x20)) first++;
+            while ((last >= first) && (p->text[y][last] <= 0x20)) last--;
+            if (first > last) continue;
+
+            char line[40 * 3 + 1];
+            size_t length = 0;
+            for (int8_t x = first; x <= last; x++)
+                length += telx_utf8(&line[length], (p->text[y][x] < 0x20) ? 0x20 : p->text[y][x]);
+            fprintf(f, "\t%.*s", (int) length, line);
+        }
+        fprintf(f, "\n");
+    }
+}
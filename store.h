@@ -0,0 +1,60 @@
+#ifndef STORE_H_INCLUDED
+#define STORE_H_INCLUDED
+
+#include <stdio.h>
+#include <inttypes.h>
+
+// number of pages a store holds, unless told otherwise; about 2 KiB each
+#define STORE_PAGES 4096
+
+// latest received content of a single (sub)page
+typedef struct store_page {
+    uint16_t page; // teletext page number (BCD), magazine 8 = 0x8xx
+    uint16_t subpage; // ETS 300 706, chapter 9.3.1.2: subcode S4 S3 S2 S1
+    uint32_t version; // incremented every time content changes, 1 = first received
+    uint64_t created; // first received at timestamp (in ms)
+    uint64_t updated; // content changed at timestamp
+    uint64_t received; // last received at timestamp
+    uint32_t rows; // bitmap of rows received; other rows of text are empty (zeros)
+    uint16_t text[25][40]; // as decoded: UCS-2 characters and spacing attributes (< 0x20)
+    // change order, least recently changed first
+    struct store_page *prev;
+    struct store_page *next;
+    // receive order, least recently received first
+    struct store_page *received_prev;
+    struct store_page *received_next;
+    uint32_t chain; // next page in the same hash bucket, pool index + 1, 0 = none
+} store_page_t;
+
+// pages of a whole teletext service in a fixed amount of memory; lookup by (page, subpage) takes a hash table
+// probe, pages changed since some time are found walking the change list from its end; if the store is full,
+// the least recently received page is evicted, so that pages still broadcast stay even if they never change
+typedef struct page_store {
+    store_page_t *pool; // capacity pages, allocated at once
+    uint32_t capacity;
+    uint32_t count; // pool entries used so far
+    uint32_t *buckets; // pool index + 1 of the first page of every bucket, 0 = empty
+    uint32_t bucket_mask; // number of buckets - 1, a power of two
+    store_page_t *oldest; // least recently changed
+    store_page_t *newest;
+    store_page_t *least_received; // evicted first
+    store_page_t *most_received;
+    uint64_t evicted;
+} page_store_t;
+
+// called for every visited page, returns NO to stop the iteration
+typedef uint8_t (*store_visit_cb_t)(void *opaque, const store_page_t *page);
+
+page_store_t *store_new(uint32_t capacity);
+void store_free(page_store_t *store);
+// records page as received at timestamp; rows not set in the rows bitmap are taken as empty
+void store_update(page_store_t *store, uint16_t page, uint16_t subpage, const uint16_t text[25][40], uint32_t rows, uint64_t timestamp);
+// NULL = page not in store
+const store_page_t *store_lookup(const page_store_t *store, uint16_t page, uint16_t subpage);
+// visits pages changed after timestamp t, most recently changed first
+void store_changed_since(const page_store_t *store, uint64_t t, store_visit_cb_t visit, void *opaque);
+// prints every page, least recently changed first: one line of page, subpage, version, timestamps
+// and text of non-empty rows (spacing attributes as spaces), each one prefixed by tag if not NULL
+void store_dump(const page_store_t *store, FILE *f, const char *tag);
+
+#endif
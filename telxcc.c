@@ -31,95 +31,31 @@ Werner Brückner -- Teletext in digital television
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
 #include <math.h>
-#include <err.h>
-#include "rtp.h"
 #include "ts.h"
 #include "hamming.h"
 #include "teletext.h"
 #include "telxcc.h"
-
-// size of a TS packet payload in bytes
-const uint8_t TS_PACKET_PAYLOAD_SIZE = TS_SIZE - TS_HEADER_SIZE;
-
-// size of a packet payload buffer
-#define PAYLOAD_BUFFER_SIZE 4096
+#include "simd.h"
 
 const char *TTXT_COLOURS[8] = {
     //black,     red,       green,     yellow,    blue,      magenta,   cyan,      white
     "#000000", "#ff0000", "#00ff00", "#ffff00", "#0000ff", "#ff00ff", "#00ffff", "#ffffff"
 };
 
-// application config global variable
-struct {
-    uint16_t page; // teletext page containing cc we want to filter
-    uint16_t tid;
-    uint64_t utc_refvalue; // UTC referential value
-} config = {
-    .page = 0,
-    .tid = 0,
-    .utc_refvalue = 0,
-};
-
-// application states -- flags for notices that should be printed only once
-struct {
-    uint8_t programme_info_processed;
-    uint8_t pts_initialized;
-} states = {
-    .programme_info_processed = NO,
-    .pts_initialized = NO
-};
-
-// subtitle type pages bitmap, 2048 bits = 2048 possible pages in teletext (excl. subpages)
-uint8_t cc_map[256] = { 0 };
-
-// global TS PCR value
-uint32_t global_timestamp = 0;
-
-// last timestamp computed
-uint64_t last_timestamp = 0;
-
-// working teletext page buffer
-teletext_page_t page_buffer = { 0 };
-
-// teletext transmission mode
-transmission_mode_t transmission_mode = TRANSMISSION_MODE_SERIAL;
-
-// flag indicating if incoming data should be processed or ignored
-uint8_t receiving_data = NO;
-
-// current charset (charset can be -- and always is -- changed during transmission)
-struct {
-    uint8_t current;
-    uint8_t g0_m29;
-    uint8_t g0_x28;
-} primary_charset = {
-    .current = 0x00,
-    .g0_m29 = UNDEF,
-    .g0_x28 = UNDEF
-};
-
 // entities, used in colour mode, to replace unsafe HTML tag chars
 struct {
     uint16_t character;
     char *entity;
+    uint8_t length;
 } const ENTITIES[] = {
-    { .character = '<', .entity = "&lt;" },
-    { .character = '>', .entity = "&gt;" },
-    { .character = '&', .entity = "&amp;" }
+    { .character = '<', .entity = "&lt;", .length = 4 },
+    { .character = '>', .entity = "&gt;", .length = 4 },
+    { .character = '&', .entity = "&amp;", .length = 5 }
 };
 
-// 0xff means not set yet
-uint8_t continuity_counter = 255;
-
-// PES packet buffer
-uint8_t payload_buffer[PAYLOAD_BUFFER_SIZE] = { 0 };
-uint16_t payload_counter = 0;
-
 // helper, array length function
 #define ARRAY_LENGTH(a) (sizeof(a)/sizeof(a[0]))
 
@@ -141,39 +77,36 @@ static uint8_t unham_8_4(uint8_t a) {
 
 // ETS 300 706, chapter 8.3
 static uint32_t unham_24_18(uint32_t a) {
-    uint8_t test = 0;
+    // Tests A-F, syndrome of the three bytes
+    uint8_t test = UNHAM_24_18_PARITY[0][a & 0xff] ^ UNHAM_24_18_PARITY[1][(a >> 8) & 0xff] ^ UNHAM_24_18_PARITY[2][(a >> 16) & 0xff];
+    uint32_t error = UNHAM_24_18_ERROR[test];
 
-    // Tests A-F correspond to bits 0-6 respectively in 'test'.
-    for (uint8_t i = 0; i < 23; i++) test ^= ((a >> i) & 0x01) * (i + 33);
-    // Only parity bit is tested for bit 24
-    test ^= ((a >> 23) & 0x01) * 32;
-
-    if ((test & 0x1f) != 0x1f) {
-        // Not all tests A-E correct
-        if ((test & 0x20) == 0x20) {
-            // F correct: Double error
-            return 0xffffffff;
-        }
-        // Test F incorrect: Single error
-        a ^= 1 << (30 - test);
-    }
+    // Not all tests A-E correct, test F correct: Double error
+    if (error == 0xffffffff) return 0xffffffff;
+    // Test F incorrect: Single error (all tests correct: error = 0)
+    a ^= error;
 
     return (a & 0x000004) >> 2 | (a & 0x000070) >> 3 | (a & 0x007f00) >> 4 | (a & 0x7f0000) >> 5;
 }
 
-static void remap_g0_charset(uint8_t c) {
-    if (c != primary_charset.current) {
-        uint8_t m = G0_LATIN_NATIONAL_SUBSETS_MAP[c];
-        if (m == 0xff) {
-            log_info("G0 Latin National Subset ID 0x%1x.%1x is not implemented", (c >> 3), (c & 0x7));
-        } else {
-            for (uint8_t j = 0; j < 13; j++)
-                G0[LATIN][G0_LATIN_NATIONAL_SUBSETS_POSITIONS[j]] = G0_LATIN_NATIONAL_SUBSETS[m].characters[j];
+// switches decoder to G0 Latin National Subset c; the subset tables are immutable, so this is a pointer swap
+static void remap_g0_charset(page_decoder_t *decoder, uint8_t c) {
+    if (c == decoder->primary_charset.current) return;
 
-            log_info("Using G0 Latin National Subset ID 0x%1x.%1x (%s)\n", (c >> 3), (c & 0x7), G0_LATIN_NATIONAL_SUBSETS[m].language);
-            primary_charset.current = c;
-        }
+    // X/28 and M/29 carry 7 bits wide IDs
+    uint8_t m = (c < ARRAY_LENGTH(G0_LATIN_NATIONAL_SUBSETS_MAP)) ? G0_LATIN_NATIONAL_SUBSETS_MAP[c] : 0xff;
+    uint8_t announce = ((decoder->primary_charset.announced[c >> 6] >> (c & 0x3f)) & 0x01) == 0;
+    decoder->primary_charset.announced[c >> 6] |= 1ULL << (c & 0x3f);
+    if (m == 0xff) {
+        if (announce) log_info("G0 Latin National Subset ID 0x%1x.%1x is not implemented", (c >> 3), (c & 0x7));
+        return;
     }
+
+    // channels alternating X/28 and M/29 designations switch back and forth, every subset is logged once
+    if (announce) log_info("Using G0 Latin National Subset ID 0x%1x.%1x (%s)", (c >> 3), (c & 0x7), G0_LATIN_NATIONAL_SUBSETS[m].language);
+    decoder->primary_charset.current = c;
+    decoder->primary_charset.g0 = G0_LATIN_SUBSETS[m];
+    decoder->primary_charset.reverse_parity_g0 = REVERSE_PARITY_G0_LATIN[m];
 }
 
 // UCS-2 (16 bits) to UTF-8 (Unicode Normalization Form C (NFC)) conversion
@@ -199,214 +132,410 @@ static void ucs2_to_utf8(char *r, uint16_t ch) {
 }
 
 // check parity and translate any reasonable teletext character into ucs2
-static uint16_t telx_to_ucs2(uint8_t c) {
+static uint16_t telx_to_ucs2(const uint16_t *g0, uint8_t c) {
     if (PARITY_8[c] == 0) {
         log_warn("Unrecoverable data error; PARITY(%02x)", c);
         return 0x20;
     }
 
     uint16_t r = c & 0x7f;
-    if (r >= 0x20) r = G0[LATIN][r - 0x20];
+    if (r >= 0x20) r = g0[r - 0x20];
     return r;
 }
 
-static void process_page(teletext_page_t *page) {
-    // optimization: slicing column by column -- higher probability we could find boxed area start mark sooner
-    uint8_t page_is_empty = YES;
-    for (uint8_t col = 0; col < 40; col++) {
-        for (uint8_t row = 1; row < 25; row++) {
-            if (page->text[row][col] == 0x0b) {
-                page_is_empty = NO;
-                goto page_is_empty;
-            }
-        }
+// UTF-8 encoding of every UCS-2 character, filled in once before main()
+typedef struct {
+    char bytes[3];
+    uint8_t length;
+} utf8_char_t;
+
+static utf8_char_t UCS2_TO_UTF8[65536];
+
+__attribute__((constructor)) static void init_ucs2_to_utf8(void) {
+    for (uint32_t ch = 0; ch < 65536; ch++) {
+        char u[4] = { 0, 0, 0, 0 };
+        ucs2_to_utf8(u, ch);
+        memcpy(UCS2_TO_UTF8[ch].bytes, u, 3);
+        UCS2_TO_UTF8[ch].length = (ch < 0x80) ? 1 : ((ch < 0x800) ? 2 : 3);
     }
-    page_is_empty:
-    if (page_is_empty == YES) return;
+}
 
-    if (page->show_timestamp > page->hide_timestamp) page->hide_timestamp = page->show_timestamp;
+// <font> opening tags, one per colour
+static char FONT_TAGS[8][FONT_TAG_LENGTH + 1];
 
-    printf("%"PRIu64"\t%"PRIu64"\t", page->show_timestamp, page->hide_timestamp);
+__attribute__((constructor)) static void init_font_tags(void) {
+    for (uint8_t i = 0; i < 8; i++)
+        snprintf(FONT_TAGS[i], sizeof(FONT_TAGS[i]), "<font color=\"%s\">", TTXT_COLOURS[i]);
+}
 
-    // process data
-    for (uint8_t row = 1; row < 25; row++) {
-        // anchors for string trimming purpose
-        uint8_t col_start = 40;
-        uint8_t col_stop = 40;
-
-        for (int8_t col = 39; col >= 0; col--) {
-            if (page->text[row][col] == 0xb) {
-                col_start = col;
-                break;
-            }
-        }
-        // line is empty
-        if (col_start > 39) continue;
+// appends n bytes to buffer at *length; callers make sure they fit
+static inline void append_bytes(char *buffer, size_t *length, const char *data, size_t n) {
+    memcpy(&buffer[*length], data, n);
+    *length += n;
+}
 
-        for (uint8_t col = col_start + 1; col <= 39; col++) {
-            if (page->text[row][col] > 0x20) {
-                if (col_stop > 39) col_start = col;
-                col_stop = col;
-            }
-            if (page->text[row][col] == 0xa) break;
-        }
+#define append_literal(buffer, length, s) append_bytes(buffer, length, s, sizeof(s) - 1)
+
+size_t telx_utf8(char *r, uint16_t ch) {
+    const utf8_char_t *u = &UCS2_TO_UTF8[ch];
+    memcpy(r, u->bytes, u->length);
+    return u->length;
+}
+
+static inline void append_utf8(char *buffer, size_t *length, uint16_t ch) {
+    const utf8_char_t *u = &UCS2_TO_UTF8[ch];
+    memcpy(&buffer[*length], u->bytes, 3);
+    *length += u->length;
+}
+
+// unsigned decimal, followed by a tab
+static void append_timestamp(char *buffer, size_t *length, uint64_t t) {
+    char digits[20];
+    uint8_t n = 0;
+    do {
+        digits[n++] = '0' + t % 10;
+        t /= 10;
+    } while (t > 0);
+    while (n > 0) buffer[(*length)++] = digits[--n];
+    buffer[(*length)++] = '\t';
+}
+
+// FNV-1a
+#define HASH_OFFSET 0xcbf29ce484222325ULL
+#define HASH_PRIME 0x100000001b3ULL
+
+static uint64_t hash_bytes(uint64_t h, const char *data, size_t n) {
+    for (size_t i = 0; i < n; i++) h = (h ^ (uint8_t) data[i]) * HASH_PRIME;
+    return h;
+}
+
+// renders row of rendered_text into row_output, boxed_rows and row_hash are updated along;
+// column bitmaps of the row are taken from page, whose row has just been copied into rendered_text
+static void render_row(page_decoder_t *decoder, const teletext_page_t *page, uint8_t row) {
+    const uint16_t *text = decoder->rendered_text[row];
+    char *out = decoder->row_output[row];
+    size_t length = 0;
+
+    decoder->row_length[row] = 0;
+    decoder->boxed_rows &= ~(1 << row);
+
+    // anchors for string trimming purpose: printable characters, on boxed pages after the last start box,
+    // up to the first end box
+    uint64_t printable = page->printable[row];
+    if (decoder->boxed == YES) {
         // line is empty
-        if (col_stop > 39) continue;
+        if (page->start_box[row] == 0) return;
+        decoder->boxed_rows |= 1 << row;
 
-        // ETS 300 706, chapter 12.2: Alpha White ("Set-After") - Start-of-row default condition.
-        // used for colour changes _before_ start box mark
-        // white is default as stated in ETS 300 706, chapter 12.2
-        // black(0), red(1), green(2), yellow(3), blue(4), magenta(5), cyan(6), white(7)
-        uint8_t foreground_color = 0x7;
-        uint8_t font_tag_opened = NO;
+        uint64_t after_start = ~((2ULL << (63 - __builtin_clzll(page->start_box[row]))) - 1);
+        uint64_t end_box = page->end_box[row] & after_start;
+        printable &= after_start;
+        if (end_box != 0) printable &= (1ULL << __builtin_ctzll(end_box)) - 1;
+    }
+    // line is empty
+    if (printable == 0) return;
+    if (decoder->boxed == NO) decoder->boxed_rows |= 1 << row;
+    uint8_t col_start = __builtin_ctzll(printable);
+    uint8_t col_stop = 63 - __builtin_clzll(printable);
+
+    // ETS 300 706, chapter 12.2: Alpha White ("Set-After") - Start-of-row default condition.
+    // used for colour changes _before_ start box mark
+    // white is default as stated in ETS 300 706, chapter 12.2
+    // black(0), red(1), green(2), yellow(3), blue(4), magenta(5), cyan(6), white(7)
+    uint8_t foreground_color = 0x7;
+    uint8_t font_tag_opened = NO;
+
+    for (uint8_t col = 0; col <= col_stop; col++) {
+        // v is just a shortcut
+        uint16_t v = text[col];
+
+        if (col < col_start) {
+            if (v <= 0x7) foreground_color = v;
+        }
 
-        for (uint8_t col = 0; col <= col_stop; col++) {
-            // v is just a shortcut
-            uint16_t v = page->text[row][col];
+        if (col == col_start) {
+            if (foreground_color != 0x7) {
+                append_bytes(out, &length, FONT_TAGS[foreground_color], FONT_TAG_LENGTH);
 
-            if (col < col_start) {
-                if (v <= 0x7) foreground_color = v;
+                font_tag_opened = YES;
             }
+        }
 
-            if (col == col_start) {
-                if (foreground_color != 0x7) {
-                    printf("<font color=\"%s\">", TTXT_COLOURS[foreground_color]);
+        if (col >= col_start) {
+            if (v <= 0x7) {
+                // ETS 300 706, chapter 12.2: Unless operating in "Hold Mosaics" mode,
+                // each character space occupied by a spacing attribute is displayed as a SPACE.
+                if (font_tag_opened == YES) {
+                    append_literal(out, &length, "</font> ");
+                    font_tag_opened = NO;
+                }
 
+                // black is considered as white for telxcc purpose
+                // telxcc writes <font/> tags only when needed
+                if ((v > 0x0) && (v < 0x7)) {
+                    append_bytes(out, &length, FONT_TAGS[v], FONT_TAG_LENGTH);
                     font_tag_opened = YES;
                 }
             }
 
-            if (col >= col_start) {
-                if (v <= 0x7) {
-                    // ETS 300 706, chapter 12.2: Unless operating in "Hold Mosaics" mode,
-                    // each character space occupied by a spacing attribute is displayed as a SPACE.
-                    if (font_tag_opened == YES) {
-                        printf("</font> ");
-                        font_tag_opened = NO;
-                    }
-
-                    // black is considered as white for telxcc purpose
-                    // telxcc writes <font/> tags only when needed
-                    if ((v > 0x0) && (v < 0x7)) {
-                        printf("<font color=\"%s\">", TTXT_COLOURS[v]);
-                        font_tag_opened = YES;
+            if (v >= 0x20) {
+                // translate some chars into entities, if in colour mode
+                for (uint8_t i = 0; i < ARRAY_LENGTH(ENTITIES); i++) {
+                    if (v == ENTITIES[i].character) {
+                        append_bytes(out, &length, ENTITIES[i].entity, ENTITIES[i].length);
+                        // v < 0x20 won't be printed in next block
+                        v = 0;
+                        break;
                     }
                 }
+            }
 
-                if (v >= 0x20) {
-                    // translate some chars into entities, if in colour mode
-                    for (uint8_t i = 0; i < ARRAY_LENGTH(ENTITIES); i++) {
-                        if (v == ENTITIES[i].character) {
-                            printf("%s", ENTITIES[i].entity);
-                            // v < 0x20 won't be printed in next block
-                            v = 0;
-                            break;
-                        }
-                    }
-                }
+            if (v >= 0x20) append_utf8(out, &length, v);
+        }
+    }
 
-                if (v >= 0x20) {
-                    char u[4] = { 0, 0, 0, 0 };
-                    ucs2_to_utf8(u, v);
-                    printf("%s", u);
-                }
-            }
+    // no tag will left opened!
+    if (font_tag_opened == YES) {
+        append_literal(out, &length, "</font>");
+        font_tag_opened = NO;
+    }
+
+    // line delimiter
+    append_literal(out, &length, "\t");
+
+    decoder->row_length[row] = length;
+    decoder->row_hash[row] = hash_bytes(HASH_OFFSET, out, length);
+}
+
+// hands the held back page over to the output
+static void output_cue(telx_decoder_t *dec, page_decoder_t *decoder) {
+    if (decoder->cue_pending == NO) return;
+
+    dec->output_length = 0;
+    // tag is shorter than MAX_TAG_LENGTH, see telx_subscribe()
+    if (decoder->tag != NULL) {
+        append_bytes(dec->output_buffer, &dec->output_length, decoder->tag, decoder->tag_length);
+        append_literal(dec->output_buffer, &dec->output_length, "\t");
+    }
+    append_timestamp(dec->output_buffer, &dec->output_length, decoder->cue_show_timestamp);
+    append_timestamp(dec->output_buffer, &dec->output_length, decoder->cue_hide_timestamp);
+    append_bytes(dec->output_buffer, &dec->output_length, decoder->cue, decoder->cue_length);
+    append_literal(dec->output_buffer, &dec->output_length, "\n");
+
+    dec->output(dec->opaque, dec->output_buffer, dec->output_length);
+    dec->output_length = 0;
+    decoder->cue_pending = NO;
+    dec->pending_cues--;
+}
+
+// held back page of decoder is output once MAX_CUE_HOLD passed its hide timestamp at stream time t
+static void expire_cue(telx_decoder_t *dec, page_decoder_t *decoder, uint64_t t) {
+    if ((decoder->cue_pending == YES) && (t >= decoder->cue_hide_timestamp + MAX_CUE_HOLD))
+        output_cue(dec, decoder);
+}
+
+// room left for the page body in output_buffer: tag, tab, two timestamps and a new line
+#define MAX_CUE_LENGTH (OUTPUT_BUFFER_SIZE - MAX_TAG_LENGTH - 1 - 2 * 21 - 1)
+
+static void process_page(telx_decoder_t *dec, page_decoder_t *decoder) {
+    teletext_page_t *page = &decoder->page_buffer;
+
+    if (dec->store != NULL) store_update(dec->store, decoder->page, decoder->subpage, (const uint16_t (*)[40]) page->text, page->rows, page->show_timestamp);
+
+    // only rows written since the page header, or non-empty last time, can differ from the rendered ones
+    uint32_t rows = (page->rows | decoder->rendered_rows) & ~0x01;
+    while (rows != 0) {
+        uint8_t row = __builtin_ctz(rows);
+        rows &= rows - 1;
+
+        // not written since the page header: empty, whatever text holds
+        if (((page->rows >> row) & 0x01) == 0) {
+            memset(decoder->rendered_text[row], 0x00, sizeof(decoder->rendered_text[row]));
+            decoder->row_length[row] = 0;
+            decoder->boxed_rows &= ~(1 << row);
+            continue;
+        }
+        if (memcmp(decoder->rendered_text[row], page->text[row], sizeof(page->text[row])) == 0) continue;
+
+        memcpy(decoder->rendered_text[row], page->text[row], sizeof(page->text[row]));
+        render_row(decoder, page, row);
+    }
+    decoder->rendered_rows = page->rows;
+
+    // no boxed area: subtitle is hidden
+    if (decoder->boxed_rows == 0) {
+        output_cue(dec, decoder);
+        return;
+    }
+
+    if (page->show_timestamp > page->hide_timestamp) page->hide_timestamp = page->show_timestamp;
+
+    uint64_t hash = HASH_OFFSET;
+    for (uint8_t row = 1; row < 25; row++)
+        if (decoder->row_length[row] > 0) hash = (hash ^ decoder->row_hash[row]) * HASH_PRIME;
+
+    // retransmission of the page held back
+    if ((decoder->cue_pending == YES) && (hash == decoder->cue_hash)) {
+        decoder->cue_hide_timestamp = page->hide_timestamp;
+        // held long enough: output so far, further retransmissions extend the next part
+        if (decoder->cue_hide_timestamp >= decoder->cue_show_timestamp + MAX_CUE_HOLD) {
+            output_cue(dec, decoder);
+            decoder->cue_pending = YES;
+            dec->pending_cues++;
+            decoder->cue_show_timestamp = decoder->cue_hide_timestamp;
         }
+        return;
+    }
 
-        // no tag will left opened!
-        if (font_tag_opened == YES) {
-            printf("</font>");
-            font_tag_opened = NO;
+    output_cue(dec, decoder);
+
+    decoder->cue_length = 0;
+    for (uint8_t row = 1; row < 25; row++) {
+        if (decoder->cue_length + decoder->row_length[row] > MAX_CUE_LENGTH) {
+            log_warn("Page %03x does not fit into output buffer, truncated", decoder->page);
+            break;
         }
+        append_bytes(decoder->cue, &decoder->cue_length, decoder->row_output[row], decoder->row_length[row]);
+    }
+    decoder->cue_pending = YES;
+    dec->pending_cues++;
+    decoder->cue_hash = hash;
+    decoder->cue_show_timestamp = page->show_timestamp;
+    decoder->cue_hide_timestamp = page->hide_timestamp;
+}
+
+// page rows are cleared when first written after the page header, rather than all of them at the header
+static inline void touch_row(teletext_page_t *page, uint8_t y) {
+    if ((page->rows >> y) & 0x01) return;
+    memset(page->text[y], 0x00, sizeof(page->text[y]));
+    page->printable[y] = 0;
+    page->start_box[y] = 0;
+    page->end_box[y] = 0;
+    page->rows |= 1 << y;
+}
 
-        // line delimiter
-        printf("\t");
+static inline void set_cell(teletext_page_t *page, uint8_t y, uint8_t x, uint16_t c) {
+    uint64_t bit = 1ULL << x;
+    touch_row(page, y);
+    page->text[y][x] = c;
+    page->printable[y] = (page->printable[y] & ~bit) | ((c > 0x20) ? bit : 0);
+    page->start_box[y] = (page->start_box[y] & ~bit) | ((c == 0x0b) ? bit : 0);
+    page->end_box[y] = (page->end_box[y] & ~bit) | ((c == 0x0a) ? bit : 0);
+}
+
+// decodes the 40 characters of a row as transmitted (bit order not reversed) in one pass through
+// reverse_parity_g0, a REVERSE_PARITY_G0_LATIN table; cells set by X/26 already (non-zero) are kept;
+// returns the number of characters failing the parity check, which are decoded as spaces
+static inline uint8_t decode_row(teletext_page_t *page, uint8_t y, const uint8_t *data, const uint16_t *reverse_parity_g0) {
+    touch_row(page, y);
+
+    uint16_t *row = page->text[y];
+    uint8_t errors = 0;
+    for (uint8_t i = 0; i < 40; i++) {
+        uint16_t c = reverse_parity_g0[data[i]];
+        errors += c >> 15;
+        row[i] = (row[i] != 0x00) ? row[i] : (c & ~PARITY_ERROR);
     }
+    kernels->row_bitmaps(row, &page->printable[y], &page->start_box[y], &page->end_box[y]);
+    return errors;
+}
 
-    printf("\n");
-    fflush(stdout);
+// ETS 300 706, chapters 9.5.1 and 9.5.3: G0 charset designated by packet M/29/0 or M/29/4 (bit reversed),
+// UNDEF = none
+static uint8_t m29_charset(const teletext_packet_payload_t *packet) {
+    uint8_t designation_code = unham_8_4(packet->data[0]);
+    if ((designation_code != 0) && (designation_code != 4)) return UNDEF;
+
+    uint32_t triplet0 = unham_24_18((packet->data[3] << 16) | (packet->data[2] << 8) | packet->data[1]);
+    if (triplet0 == 0xffffffff) {
+        // invalid data (HAM24/18 uncorrectable error detected), skip group
+        log_warn("Unrecoverable data error; UNHAM24/18()=%04x", triplet0);
+        return UNDEF;
+    }
+
+    // ETS 300 706, table 11: Coding of Packet M/29/0
+    // ETS 300 706, table 13: Coding of Packet M/29/4
+    return ((triplet0 & 0xff) == 0x00) ? (triplet0 & 0x3f80) >> 7 : UNDEF;
 }
 
-static void process_telx_packet(data_unit_t data_unit_id, teletext_packet_payload_t *packet, uint64_t timestamp) {
-    // variable names conform to ETS 300 706, chapter 7.1.2
-    uint8_t address = (unham_8_4(packet->address[1]) << 4) | unham_8_4(packet->address[0]);
-    uint8_t m = address & 0x7;
-    if (m == 0) m = 8;
-    uint8_t y = (address >> 3) & 0x1f;
+static void set_m29_charset(page_decoder_t *decoder, uint8_t charset) {
+    decoder->primary_charset.g0_m29 = charset;
+    // X/28 takes precedence over M/29
+    if (decoder->primary_charset.g0_x28 == UNDEF) {
+        remap_g0_charset(decoder, charset);
+    }
+}
+
+// m and y as decoded by process_telx_packet; packet is bit reversed, except for rows 1-23
+static void process_page_packet(telx_decoder_t *dec, page_decoder_t *decoder, pid_stream_t *stream, uint8_t m, uint8_t y, const teletext_packet_payload_t *packet, uint64_t timestamp) {
     uint8_t designation_code = (y > 25) ? unham_8_4(packet->data[0]) : 0x00;
 
     if (y == 0) {
-        // CC map
-        uint8_t i = (unham_8_4(packet->data[1]) << 4) | unham_8_4(packet->data[0]);
-        uint8_t flag_subtitle = (unham_8_4(packet->data[5]) & 0x08) >> 3;
-        cc_map[i] |= flag_subtitle << (m - 1);
-
         // Page number and control bits
         uint16_t page_number = (m << 8) | (unham_8_4(packet->data[1]) << 4) | unham_8_4(packet->data[0]);
         uint8_t charset = ((unham_8_4(packet->data[7]) & 0x08) | (unham_8_4(packet->data[7]) & 0x04) | (unham_8_4(packet->data[7]) & 0x02)) >> 1;
         //uint8_t flag_suppress_header = unham_8_4(packet->data[6]) & 0x01;
         //uint8_t flag_inhibit_display = (unham_8_4(packet->data[6]) & 0x08) >> 3;
 
-        // ETS 300 706, chapter 9.3.1.3:
-        // When set to '1' the service is designated to be in Serial mode and the transmission of a page is terminated
-        // by the next page header with a different page number.
-        // When set to '0' the service is designated to be in Parallel mode and the transmission of a page is terminated
-        // by the next page header with a different page number but the same magazine number.
-        // The same setting shall be used for all page headers in the service.
-        // ETS 300 706, chapter 7.2.1: Page is terminated by and excludes the next page header packet
-        // having the same magazine address in parallel transmission mode, or any magazine address in serial transmission mode.
-        transmission_mode = unham_8_4(packet->data[7]) & 0x01;
-
-        // FIXME: Well, this is not ETS 300 706 kosher, however we are interested in DATA_UNIT_EBU_TELETEXT_SUBTITLE only
-        if ((transmission_mode == TRANSMISSION_MODE_PARALLEL) && (data_unit_id != DATA_UNIT_EBU_TELETEXT_SUBTITLE)) return;
-
-        if ((receiving_data == YES) && (
-                ((transmission_mode == TRANSMISSION_MODE_SERIAL) && (PAGE(page_number) != PAGE(config.page))) ||
-                ((transmission_mode == TRANSMISSION_MODE_PARALLEL) && (PAGE(page_number) != PAGE(config.page)) && (m == MAGAZINE(config.page)))
+        if ((decoder->receiving_data == YES) && (
+                ((stream->transmission_mode == TRANSMISSION_MODE_SERIAL) && (PAGE(page_number) != PAGE(decoder->page))) ||
+                ((stream->transmission_mode == TRANSMISSION_MODE_PARALLEL) && (PAGE(page_number) != PAGE(decoder->page)) && (m == MAGAZINE(decoder->page)))
             )) {
-            receiving_data = NO;
+            decoder->receiving_data = NO;
             return;
         }
 
         // Page transmission is terminated, however now we are waiting for our new page
-        if (page_number != config.page) return;
+        if (page_number != decoder->page) {
+            // page is not retransmitted anymore: the held back one is not extended after all
+            expire_cue(dec, decoder, timestamp);
+            return;
+        }
 
         // Now we have the begining of page transmission; if there is page_buffer pending, process it
-        if (page_buffer.tainted == YES) {
+        if (decoder->page_buffer.tainted == YES) {
             // it would be nice, if subtitle hides on previous video frame, so we contract 40 ms (1 frame @25 fps)
-            page_buffer.hide_timestamp = timestamp - 40;
-            process_page(&page_buffer);
+            decoder->page_buffer.hide_timestamp = timestamp - 40;
+            process_page(dec, decoder);
         }
-
-        page_buffer.show_timestamp = timestamp;
-        page_buffer.hide_timestamp = 0;
-        memset(page_buffer.text, 0x00, sizeof(page_buffer.text));
-        page_buffer.tainted = NO;
-        receiving_data = YES;
-        primary_charset.g0_x28 = UNDEF;
-
-        uint8_t c = (primary_charset.g0_m29 != UNDEF) ? primary_charset.g0_m29 : charset;
-        remap_g0_charset(c);
+        // nothing received since last header: page is blank
+        else output_cue(dec, decoder);
+
+        // ETS 300 706, chapter 9.3.1.2: subcode S1 (4 bits), S2 (3 bits), S3 (4 bits), S4 (2 bits)
+        decoder->subpage = unham_8_4(packet->data[2]) | ((unham_8_4(packet->data[3]) & 0x07) << 4) |
+            (unham_8_4(packet->data[4]) << 8) | ((unham_8_4(packet->data[5]) & 0x03) << 12);
+        decoder->page_buffer.show_timestamp = timestamp;
+        decoder->page_buffer.hide_timestamp = 0;
+        // rows are cleared as they are written, see touch_row()
+        decoder->page_buffer.rows = 0;
+        decoder->page_buffer.tainted = NO;
+        decoder->receiving_data = YES;
+        decoder->primary_charset.g0_x28 = UNDEF;
+
+        uint8_t c = (decoder->primary_charset.g0_m29 != UNDEF) ? decoder->primary_charset.g0_m29 : charset;
+        remap_g0_charset(decoder, c);
 
         /*
         // I know -- not needed; in subtitles we will never need disturbing teletext page status bar
         // displaying tv station name, current time etc.
         if (flag_suppress_header == NO) {
-            for (uint8_t i = 14; i < 40; i++) page_buffer.text[y][i] = telx_to_ucs2(packet->data[i]);
-            //page_buffer.tainted = YES;
+            for (uint8_t i = 14; i < 40; i++) decoder->page_buffer.text[y][i] = telx_to_ucs2(decoder->primary_charset.g0, packet->data[i]);
+            //decoder->page_buffer.tainted = YES;
         }
         */
     }
-    else if ((m == MAGAZINE(config.page)) && (y >= 1) && (y <= 23) && (receiving_data == YES)) {
+    else if ((m == MAGAZINE(decoder->page)) && (y >= 1) && (y <= 23) && (decoder->receiving_data == YES)) {
         // ETS 300 706, chapter 9.4.1: Packets X/26 at presentation Levels 1.5, 2.5, 3.5 are used for addressing
         // a character location and overwriting the existing character defined on the Level 1 page
         // ETS 300 706, annex B.2.2: Packets with Y = 26 shall be transmitted before any packets with Y = 1 to Y = 25;
-        // so page_buffer.text[y][i] may already contain any character received
+        // so decoder->page_buffer.text[y][i] may already contain any character received
         // in frame number 26, skip original G0 character
-        for (uint8_t i = 0; i < 40; i++) if (page_buffer.text[y][i] == 0x00) page_buffer.text[y][i] = telx_to_ucs2(packet->data[i]);
-        page_buffer.tainted = YES;
+        // packet->data of rows is left as transmitted
+        uint8_t errors = decode_row(&decoder->page_buffer, y, packet->data, decoder->primary_charset.reverse_parity_g0);
+        if (errors > 0) log_warn("Unrecoverable data error; PARITY of %u characters in row %u", errors, y);
+        decoder->page_buffer.tainted = YES;
     }
-    else if ((m == MAGAZINE(config.page)) && (y == 26) && (receiving_data == YES)) {
+    else if ((m == MAGAZINE(decoder->page)) && (y == 26) && (decoder->receiving_data == YES)) {
         // ETS 300 706, chapter 12.3.2: X/26 definition
         uint8_t x26_row = 0;
         uint8_t x26_col = 0;
@@ -439,7 +568,7 @@ static void process_telx_packet(data_unit_t data_unit_id, teletext_packet_payloa
             // ETS 300 706, chapter 12.3.1, table 27: character from G2 set
             if ((mode == 0x0f) && (row_address_group == NO)) {
                 x26_col = address;
-                if (data > 31) page_buffer.text[x26_row][x26_col] = G2[0][data - 0x20];
+                if (data > 31) set_cell(&decoder->page_buffer, x26_row, x26_col, G2[0][data - 0x20]);
             }
 
             // ETS 300 706, chapter 12.3.1, table 27: G0 character with diacritical mark
@@ -447,15 +576,15 @@ static void process_telx_packet(data_unit_t data_unit_id, teletext_packet_payloa
                 x26_col = address;
 
                 // A - Z
-                if ((data >= 65) && (data <= 90)) page_buffer.text[x26_row][x26_col] = G2_ACCENTS[mode - 0x11][data - 65];
+                if ((data >= 65) && (data <= 90)) set_cell(&decoder->page_buffer, x26_row, x26_col, G2_ACCENTS[mode - 0x11][data - 65]);
                 // a - z
-                else if ((data >= 97) && (data <= 122)) page_buffer.text[x26_row][x26_col] = G2_ACCENTS[mode - 0x11][data - 71];
+                else if ((data >= 97) && (data <= 122)) set_cell(&decoder->page_buffer, x26_row, x26_col, G2_ACCENTS[mode - 0x11][data - 71]);
                 // other
-                else page_buffer.text[x26_row][x26_col] = telx_to_ucs2(data);
+                else set_cell(&decoder->page_buffer, x26_row, x26_col, telx_to_ucs2(decoder->primary_charset.g0, data));
             }
         }
     }
-    else if ((m == MAGAZINE(config.page)) && (y == 28) && (receiving_data == YES)) {
+    else if ((m == MAGAZINE(decoder->page)) && (y == 28) && (decoder->receiving_data == YES)) {
         // TODO:
         //   ETS 300 706, chapter 9.4.7: Packet X/28/4
         //   Where packets 28/0 and 28/4 are both transmitted as part of a page, packet 28/0 takes precedence over 28/4 for all but the colour map entry coding.
@@ -471,46 +600,235 @@ static void process_telx_packet(data_unit_t data_unit_id, teletext_packet_payloa
             else {
                 // ETS 300 706, chapter 9.4.2: Packet X/28/0 Format 1 only
                 if ((triplet0 & 0x0f) == 0x00) {
-                    primary_charset.g0_x28 = (triplet0 & 0x3f80) >> 7;
-                    remap_g0_charset(primary_charset.g0_x28);
+                    decoder->primary_charset.g0_x28 = (triplet0 & 0x3f80) >> 7;
+                    remap_g0_charset(decoder, decoder->primary_charset.g0_x28);
                 }
             }
         }
     }
-    else if ((m == MAGAZINE(config.page)) && (y == 29)) {
+    else if ((m == MAGAZINE(decoder->page)) && (y == 29)) {
         // TODO:
         //   ETS 300 706, chapter 9.5.1 Packet M/29/0
         //   Where M/29/0 and M/29/4 are transmitted for the same magazine, M/29/0 takes precedence over M/29/4.
-        if ((designation_code == 0) || (designation_code == 4)) {
-            // ETS 300 706, chapter 9.5.1: Packet M/29/0
-            // ETS 300 706, chapter 9.5.3: Packet M/29/4
-            uint32_t triplet0 = unham_24_18((packet->data[3] << 16) | (packet->data[2] << 8) | packet->data[1]);
+        uint8_t charset = m29_charset(packet);
+        if (charset != UNDEF) set_m29_charset(decoder, charset);
+    }
+}
 
-            if (triplet0 == 0xffffffff) {
-                // invalid data (HAM24/18 uncorrectable error detected), skip group
-                log_warn("Unrecoverable data error; UNHAM24/18()=%04x", triplet0);
-            }
-            else {
-                // ETS 300 706, table 11: Coding of Packet M/29/0
-                // ETS 300 706, table 13: Coding of Packet M/29/4
-                if ((triplet0 & 0xff) == 0x00) {
-                    primary_charset.g0_m29 = (triplet0 & 0x3f80) >> 7;
-                    // X/28 takes precedence over M/29
-                    if (primary_charset.g0_x28 == UNDEF) {
-                        remap_g0_charset(primary_charset.g0_m29);
-                    }
-                }
-            }
+// page is not being received anymore: outputs it along with the held back one, e.g. at the end of input
+static void finish_page(telx_decoder_t *dec, pid_stream_t *stream, page_decoder_t *decoder) {
+    if (decoder->page_buffer.tainted == YES) {
+        decoder->page_buffer.hide_timestamp = stream->last_timestamp;
+        process_page(dec, decoder);
+        decoder->page_buffer.tainted = NO;
+    }
+    output_cue(dec, decoder);
+    decoder->receiving_data = NO;
+}
+
+// boxed display of a cached page follows flags of its header; rows rendered the other way are dropped
+static void set_boxed(telx_decoder_t *dec, page_decoder_t *decoder, uint8_t boxed) {
+    if (decoder->boxed == boxed) return;
+
+    output_cue(dec, decoder);
+    memset(decoder->rendered_text, 0x00, sizeof(decoder->rendered_text));
+    memset(decoder->row_length, 0x00, sizeof(decoder->row_length));
+    decoder->boxed_rows = 0;
+    decoder->boxed = boxed;
+}
+
+static void init_page_decoder(page_decoder_t *decoder, uint16_t page, const char *tag) {
+    decoder->page = page;
+    decoder->tag = tag;
+    decoder->tag_length = (tag != NULL) ? strlen(tag) : 0;
+    decoder->boxed = YES;
+    decoder->receiving_data = NO;
+    decoder->primary_charset.current = 0x00;
+    decoder->primary_charset.g0_m29 = UNDEF;
+    decoder->primary_charset.g0_x28 = UNDEF;
+    decoder->primary_charset.g0 = G0_LATIN_SUBSETS[0];
+    decoder->primary_charset.reverse_parity_g0 = REVERSE_PARITY_G0_LATIN[0];
+}
+
+// page_cache_t index of page (BCD)
+#define CACHE_INDEX(p) (((MAGAZINE(p) & 0x07) << 8) | PAGE(p))
+
+static void lru_append(page_cache_t *cache, page_decoder_t *decoder) {
+    decoder->lru_prev = cache->lru_tail;
+    decoder->lru_next = NULL;
+    if (cache->lru_tail != NULL) cache->lru_tail->lru_next = decoder;
+    else cache->lru_head = decoder;
+    cache->lru_tail = decoder;
+}
+
+static void lru_unlink(page_cache_t *cache, page_decoder_t *decoder) {
+    if (decoder->lru_prev != NULL) decoder->lru_prev->lru_next = decoder->lru_next;
+    else if (cache->lru_head == decoder) cache->lru_head = decoder->lru_next;
+    // not listed
+    else return;
+
+    if (decoder->lru_next != NULL) decoder->lru_next->lru_prev = decoder->lru_prev;
+    else cache->lru_tail = decoder->lru_prev;
+    decoder->lru_prev = NULL;
+    decoder->lru_next = NULL;
+}
+
+static void free_cache(page_cache_t *cache) {
+    for (uint16_t i = 0; i < cache->count; i++)
+        free(cache->pool[i]);
+    free(cache->pool);
+    free(cache);
+}
+
+// decoder of page_number, allocated while the pool is not used up, taken from the least recently received page
+// otherwise; NULL = every cached page is a subtitle, or out of memory
+static page_decoder_t *cache_page(telx_decoder_t *dec, pid_stream_t *stream, uint16_t page_number) {
+    page_cache_t *cache = stream->cache;
+    page_decoder_t *decoder = NULL;
+
+    if (cache->index[CACHE_INDEX(page_number)] > 0) {
+        decoder = cache->pool[cache->index[CACHE_INDEX(page_number)] - 1];
+        if (decoder->subtitle == NO) {
+            lru_unlink(cache, decoder);
+            lru_append(cache, decoder);
+        }
+        return decoder;
+    }
+
+    uint16_t entry;
+    if (cache->count < cache->capacity) {
+        decoder = calloc(1, sizeof(page_decoder_t));
+        if (decoder == NULL) {
+            log_warn("Out of memory, page %03x not cached", page_number);
+            return NULL;
+        }
+        entry = cache->count++;
+        cache->pool[entry] = decoder;
+    } else {
+        decoder = cache->lru_head;
+        if (decoder == NULL) {
+            if ((cache->dropped++ % 1000) == 0)
+                log_warn("Page cache full of subtitle pages, %"PRIu64" page headers dropped", cache->dropped);
+            return NULL;
+        }
+
+        finish_page(dec, stream, decoder);
+        lru_unlink(cache, decoder);
+        for (uint8_t i = 0; i < 8; i++) if (cache->receiving[i] == decoder) cache->receiving[i] = NULL;
+        entry = cache->index[CACHE_INDEX(decoder->page)] - 1;
+        cache->index[CACHE_INDEX(decoder->page)] = 0;
+        cache->evicted++;
+        memset(decoder, 0, offsetof(page_decoder_t, row_output));
+    }
+
+    // every output line starts with the page number
+    snprintf(decoder->tag_buffer, sizeof(decoder->tag_buffer), "%s%s%03x",
+        (cache->tag != NULL) ? cache->tag : "", (cache->tag != NULL) ? "\t" : "", page_number);
+    init_page_decoder(decoder, page_number, decoder->tag_buffer);
+    // boxed or not is told by the page header
+    decoder->boxed = NO;
+    decoder->primary_charset.g0_m29 = cache->g0_m29[MAGAZINE(page_number) - 1];
+    lru_append(cache, decoder);
+    cache->index[CACHE_INDEX(page_number)] = entry + 1;
+    return decoder;
+}
+
+// whole service: every packet is handed over to the pages it may concern only
+static void process_cache_packet(telx_decoder_t *dec, pid_stream_t *stream, uint8_t m, uint8_t y, const teletext_packet_payload_t *packet, uint64_t timestamp) {
+    page_cache_t *cache = stream->cache;
+
+    if (y == 0) {
+        uint16_t page_number = (m << 8) | (unham_8_4(packet->data[1]) << 4) | unham_8_4(packet->data[0]);
+
+        // header terminates pages being received as the transmission mode says, see process_page_packet()
+        for (uint8_t i = 0; i < 8; i++) {
+            page_decoder_t *decoder = cache->receiving[i];
+            if ((decoder == NULL) || (decoder->page == page_number)) continue;
+
+            process_page_packet(dec, decoder, stream, m, y, packet, timestamp);
+            if (decoder->receiving_data == NO) cache->receiving[i] = NULL;
+        }
+
+        // time filling headers (page FF) and pages not meant to be displayed are not cached
+        if (((page_number & 0x0f) > 0x09) || ((page_number & 0xf0) > 0x90)) return;
+
+        page_decoder_t *decoder = cache_page(dec, stream, page_number);
+        if (decoder == NULL) return;
+        process_page_packet(dec, decoder, stream, m, y, packet, timestamp);
+        cache->receiving[m - 1] = decoder;
+
+        // ETS 300 706, chapter 9.3.1.3: C5 newsflash and C6 subtitle pages are displayed boxed
+        uint8_t flags = unham_8_4(packet->data[5]);
+        set_boxed(dec, decoder, ((flags & 0x0c) > 0) ? YES : NO);
+        if (((flags & 0x08) > 0) && (decoder->subtitle == NO)) {
+            decoder->subtitle = YES;
+            lru_unlink(cache, decoder);
+        }
+    }
+    else if (y <= 28) {
+        if (cache->receiving[m - 1] != NULL) process_page_packet(dec, cache->receiving[m - 1], stream, m, y, packet, timestamp);
+    }
+    else if (y == 29) {
+        uint8_t charset = m29_charset(packet);
+        if (charset == UNDEF) return;
+
+        // M/29 applies to every page of the magazine, also to pages not cached yet
+        cache->g0_m29[m - 1] = charset;
+        for (uint16_t i = 0; i < cache->count; i++) {
+            page_decoder_t *decoder = cache->pool[i];
+            if (MAGAZINE(decoder->page) == m) set_m29_charset(decoder, charset);
         }
     }
+}
+
+// packet as transmitted (bit order not reversed), left untouched: it may point right into a receive buffer
+static void process_telx_packet(telx_decoder_t *dec, pid_stream_t *stream, data_unit_t data_unit_id, const teletext_packet_payload_t *transmitted, uint64_t timestamp) {
+    // packet address in one lookup, straight from the bytes as transmitted
+    uint16_t address = REVERSE_UNHAM_8_4_16[transmitted->address[0] | (transmitted->address[1] << 8)];
+    if ((address & UNHAM_ERROR) == UNHAM_ERROR) log_warn("Unrecoverable data error; UNHAM8/4(packet address)");
+
+    // variable names conform to ETS 300 706, chapter 7.1.2
+    uint8_t m = address & 0x7;
+    if (m == 0) m = 8;
+    uint8_t y = (address >> 3) & 0x1f;
+
+    // rows are decoded from the bytes as transmitted, every other packet is reversed, ETS 300 706, chapter 7.1
+    const teletext_packet_payload_t *packet = transmitted;
+    teletext_packet_payload_t reversed;
+    if ((y == 0) || (y > 23)) {
+        memcpy(&reversed, transmitted, sizeof(reversed));
+        kernels->reverse_unit((uint8_t *) &reversed);
+        packet = &reversed;
+    }
+
+    uint8_t subscriptions = YES;
+    if (y == 0) {
+        // CC map
+        uint8_t i = (unham_8_4(packet->data[1]) << 4) | unham_8_4(packet->data[0]);
+        uint8_t flag_subtitle = (unham_8_4(packet->data[5]) & 0x08) >> 3;
+        dec->cc_map[i] |= flag_subtitle << (m - 1);
+
+        // ETS 300 706, chapter 9.3.1.3:
+        // When set to '1' the service is designated to be in Serial mode and the transmission of a page is terminated
+        // by the next page header with a different page number.
+        // When set to '0' the service is designated to be in Parallel mode and the transmission of a page is terminated
+        // by the next page header with a different page number but the same magazine number.
+        // The same setting shall be used for all page headers in the service.
+        // ETS 300 706, chapter 7.2.1: Page is terminated by and excludes the next page header packet
+        // having the same magazine address in parallel transmission mode, or any magazine address in serial transmission mode.
+        stream->transmission_mode = unham_8_4(packet->data[7]) & 0x01;
+
+        // FIXME: Well, this is not ETS 300 706 kosher, however subscribed pages are interested in DATA_UNIT_EBU_TELETEXT_SUBTITLE only
+        if ((stream->transmission_mode == TRANSMISSION_MODE_PARALLEL) && (data_unit_id != DATA_UNIT_EBU_TELETEXT_SUBTITLE)) subscriptions = NO;
+    }
     else if ((m == 8) && (y == 30)) {
         // ETS 300 706, chapter 9.8: Broadcast Service Data Packets
-        if (states.programme_info_processed == NO) {
+        if (dec->programme_info_processed == NO) {
             // ETS 300 706, chapter 9.8.1: Packet 8/30 Format 1
             if (unham_8_4(packet->data[0]) < 2) {
                 fprintf(stderr, "[INFO] Programme Identification Data = ");
                 for (uint8_t i = 20; i < 40; i++) {
-                    uint8_t c = telx_to_ucs2(packet->data[i]);
+                    uint8_t c = telx_to_ucs2(G0_LATIN_SUBSETS[0], packet->data[i]);
                     // strip any control codes from PID, eg. TVP station
                     if (c < 0x20) continue;
 
@@ -547,65 +865,78 @@ static void process_telx_packet(data_unit_t data_unit_id, teletext_packet_payloa
                 t0 -= diff;
 
                 log_info("Programme Timestamp (UTC) = %s", ctime(&t0));
-                log_info("Transmission mode = %s", (transmission_mode == TRANSMISSION_MODE_SERIAL ? "serial" : "parallel"));
+                log_info("Transmission mode = %s", (stream->transmission_mode == TRANSMISSION_MODE_SERIAL ? "serial" : "parallel"));
                 log_info("Broadcast Service Data Packet received, resetting UTC referential value to %s", ctime(&t0));
 
-                config.utc_refvalue = (uint32_t) t0;
-                states.pts_initialized = NO;
+                dec->utc_refvalue = (uint32_t) t0;
+                for (uint8_t i = 0; i < dec->stream_count; i++) dec->streams[i]->pts_initialized = NO;
 
-                states.programme_info_processed = YES;
+                dec->programme_info_processed = YES;
             }
         }
+        return;
+    }
+
+    // the packet is parsed once per PID, every page carried in it gets its copy
+    if (subscriptions == YES) {
+        for (uint8_t i = 0; i < stream->page_count; i++)
+            process_page_packet(dec, stream->pages[i], stream, m, y, packet, timestamp);
     }
+    if (stream->cache != NULL) process_cache_packet(dec, stream, m, y, packet, timestamp);
 }
 
-static void process_pes_packet(uint8_t *buffer, uint16_t size) {
-    if (size < 6) return;
+// length of the PES header starting with the given bytes, up to and including data_identifier;
+// more bytes are needed to tell it while the returned length is larger than length
+static uint16_t pes_header_length(const uint8_t *header, uint16_t length) {
+    if (length < 7) return 7;
+    // no optional PES header (marker bits 10.. ....), header[6] is data_identifier
+    if ((header[6] & 0xc0) != 0x80) return 7;
+    if (length < 9) return 9;
+    return 9 + header[8] + 1;
+}
+
+// complete PES header gathered in carry, returns NO if the PES packet is not to be processed
+static uint8_t process_pes_header(telx_decoder_t *dec, pid_stream_t *stream, uint16_t header_length) {
+    const uint8_t *buffer = stream->carry;
 
     // Packetized Elementary Stream (PES) 32-bit start code
     uint64_t pes_prefix = (buffer[0] << 16) | (buffer[1] << 8) | buffer[2];
     uint8_t pes_stream_id = buffer[3];
 
     // check for PES header
-    if (pes_prefix != 0x000001) return;
+    if (pes_prefix != 0x000001) return NO;
 
     // stream_id is not "Private Stream 1" (0xbd)
-    if (pes_stream_id != 0xbd) return;
+    if (pes_stream_id != 0xbd) return NO;
 
     // PES packet length
     // ETSI EN 301 775 V1.2.1 (2003-05) chapter 4.3: (N x 184) - 6 + 6 B header
-    uint16_t pes_packet_length = 6 + ((buffer[4] << 8) | buffer[5]);
+    uint32_t pes_packet_length = 6 + ((buffer[4] << 8) | buffer[5]);
     // Can be zero. If the "PES packet length" is set to zero, the PES packet can be of any length.
     // A value of zero for the PES packet length can be used only when the PES packet payload is a video elementary stream.
-    if (pes_packet_length == 6) return;
-
-    // truncate incomplete PES packets
-    if (pes_packet_length > size) pes_packet_length = size;
+    if (pes_packet_length == 6) return NO;
+    if (pes_packet_length < header_length) return NO;
+    stream->pes_remaining = pes_packet_length - header_length;
 
     uint8_t optional_pes_header_included = NO;
-    uint16_t optional_pes_header_length = 0;
     // optional PES header marker bits (10.. ....)
-    if ((buffer[6] & 0xc0) == 0x80) {
-        optional_pes_header_included = YES;
-        optional_pes_header_length = buffer[8];
-    }
+    if ((buffer[6] & 0xc0) == 0x80) optional_pes_header_included = YES;
 
     // should we use PTS or PCR?
-    static uint8_t using_pts = UNDEF;
-    if (using_pts == UNDEF) {
+    if (stream->using_pts == UNDEF) {
         if ((optional_pes_header_included == YES) && ((buffer[7] & 0x80) > 0)) {
-            using_pts = YES;
+            stream->using_pts = YES;
             log_warn("PID 0xbd PTS available");
         } else {
-            using_pts = NO;
+            stream->using_pts = NO;
             log_warn("PID 0xbd PTS unavailable, using TS PCR");
         }
     }
 
     uint32_t t = 0;
     // If there is no PTS available, use global PCR
-    if (using_pts == NO) {
-        t = global_timestamp;
+    if (stream->using_pts == NO) {
+        t = dec->global_timestamp;
     }
     else {
         // PTS is 33 bits wide, however, timestamp in ms fits into 32 bits nicely (PTS/90)
@@ -622,44 +953,373 @@ static void process_pes_packet(uint8_t *buffer, uint16_t size) {
         t = pts / 90;
     }
 
-    static int64_t delta = 0;
-    static uint32_t t0 = 0;
-    if (states.pts_initialized == NO) {
-        delta = 1000 * config.utc_refvalue - t;
-        states.pts_initialized = YES;
+    if (stream->pts_initialized == NO) {
+        stream->delta = 1000 * dec->utc_refvalue - t;
+        stream->pts_initialized = YES;
 
-        if ((using_pts == NO) && (global_timestamp == 0)) {
+        if ((stream->using_pts == NO) && (dec->global_timestamp == 0)) {
             // We are using global PCR, nevertheless we still have not received valid PCR timestamp yet
-            states.pts_initialized = NO;
+            stream->pts_initialized = NO;
+        }
+    }
+    if (t < stream->t0) stream->delta = stream->last_timestamp;
+    stream->last_timestamp = t + stream->delta;
+    stream->t0 = t;
+
+    return YES;
+}
+
+// data_unit_id, data_unit_length and data_unit_length bytes of data
+static void process_data_unit(telx_decoder_t *dec, pid_stream_t *stream, const uint8_t *unit) {
+    uint8_t data_unit_id = unit[0];
+    uint8_t data_unit_len = unit[1];
+
+    if ((data_unit_id == DATA_UNIT_EBU_TELETEXT_NONSUBTITLE) || (data_unit_id == DATA_UNIT_EBU_TELETEXT_SUBTITLE)) {
+        // teletext payload has always size 44 bytes
+        if (data_unit_len == 44) {
+            // FIXME: This explicit type conversion could be a problem some day -- do not need to be platform independant
+            process_telx_packet(dec, stream, data_unit_id, (const teletext_packet_payload_t *) &unit[2], stream->last_timestamp);
         }
     }
-    if (t < t0) delta = last_timestamp;
-    last_timestamp = t + delta;
-    t0 = t;
+}
+
+// gathers up to needed bytes in carry, returns the number of bytes taken from data
+static uint16_t gather(pid_stream_t *stream, const uint8_t *data, uint16_t length, uint16_t needed) {
+    uint16_t n = needed - stream->carry_length;
+    if (n > length) n = length;
+    memcpy(&stream->carry[stream->carry_length], data, n);
+    stream->carry_length += n;
+    return n;
+}
+
+// TS packet payload of a teletext PID; data units are processed as soon as they are complete, straight
+// from the payload unless split across TS packets (EN 300 472 aligns them, so they never are in practice)
+static void process_pes_payload(telx_decoder_t *dec, pid_stream_t *stream, const uint8_t *data, uint16_t length, uint8_t unit_start) {
+    if (unit_start > 0) {
+        stream->pes_state = PES_HEADER;
+        stream->carry_length = 0;
+    }
+
+    while (length > 0) {
+        if (stream->pes_state == PES_IDLE) return;
+
+        if (stream->pes_state == PES_HEADER) {
+            uint16_t n = gather(stream, data, length, pes_header_length(stream->carry, stream->carry_length));
+            data += n;
+            length -= n;
+            // the header is complete once its length, as told by the bytes gathered so far, is reached
+            if (pes_header_length(stream->carry, stream->carry_length) > stream->carry_length) continue;
+
+            stream->pes_state = (process_pes_header(dec, stream, stream->carry_length) == YES) ? PES_DATA_UNITS : PES_IDLE;
+            stream->carry_length = 0;
+            continue;
+        }
+
+        // the rest of the TS packet past the end of the PES packet is stuffing
+        uint16_t available = (stream->pes_remaining < length) ? stream->pes_remaining : length;
+        if (available == 0) {
+            stream->pes_state = PES_IDLE;
+            return;
+        }
+
+        if ((stream->carry_length == 0) && (available >= 2) && (available >= 2 + data[1])) {
+            uint16_t n = 2 + data[1];
+            process_data_unit(dec, stream, data);
+            data += n;
+            length -= n;
+            stream->pes_remaining -= n;
+            continue;
+        }
+
+        uint16_t needed = (stream->carry_length < 2) ? 2 : 2 + stream->carry[1];
+        uint16_t n = gather(stream, data, available, needed);
+        data += n;
+        length -= n;
+        stream->pes_remaining -= n;
+        if ((stream->carry_length >= 2) && (stream->carry_length == 2 + stream->carry[1])) {
+            process_data_unit(dec, stream, stream->carry);
+            stream->carry_length = 0;
+        }
+    }
+}
+
+// PCR in adaptation field; caller has checked that it is present
+static void update_pcr(telx_decoder_t *dec, const uint8_t *ts_packet) {
+    uint64_t pts = ts_packet[6];
+    pts <<= 25;
+    pts |= (ts_packet[7] << 17);
+    pts |= (ts_packet[8] << 9);
+    pts |= (ts_packet[9] << 1);
+    pts |= (ts_packet[10] >> 7);
+    dec->global_timestamp = pts / 90;
+    pts = ((ts_packet[10] & 0x01) << 8);
+    pts |= ts_packet[11];
+    dec->global_timestamp += pts / 27000;
+}
+
+static void pid_filter_set(telx_decoder_t *dec, uint16_t pid) {
+    dec->pid_filter[pid >> 6] |= 1ULL << (pid & 0x3f);
+}
+
+static void pid_filter_clear(telx_decoder_t *dec, uint16_t pid) {
+    dec->pid_filter[pid >> 6] &= ~(1ULL << (pid & 0x3f));
+}
+
+// MPEG-2 CRC-32 (ISO/IEC 13818-1, Annex A); a section including its CRC_32 field yields 0
+static uint32_t psi_crc32(const uint8_t *data, size_t length) {
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint32_t) data[i] << 24;
+        for (uint8_t j = 0; j < 8; j++) crc = (crc & 0x80000000) ? ((crc << 1) ^ 0x04c11db7) : (crc << 1);
+    }
+    return crc;
+}
+
+static void process_pat(telx_decoder_t *dec, const uint8_t *section) {
+    pat_t pat = { 0 };
+    pat.table_id = section[0];
+    pat.section_length = ((section[1] & 0x0f) << 8) | section[2];
+    pat.current_next_indicator = section[5] & 0x01;
+    if (pat.table_id != 0x00)
+        return;
+
+    // forget programs of the previous PAT version
+    for (uint8_t i = 0; i < dec->program_count; i++) {
+        uint16_t pid = dec->programs[i].pmt_pid;
+        dec->pid_table[pid] = 0;
+        pid_filter_clear(dec, pid);
+    }
+    dec->program_count = 0;
+    dec->program_num = 0;
+
+    // program loop, CRC_32 excluded
+    for (uint16_t i = 8; i + 4 <= 3 + pat.section_length - 4; i += 4) {
+        pat_section_t entry = { 0 };
+        entry.program_num = (section[i] << 8) | section[i + 1];
+        entry.program_pid = ((section[i + 2] & 0x1f) << 8) | section[i + 3];
+
+        // network PID
+        if (entry.program_num == 0)
+            continue;
+
+        if (dec->program_count == MAX_PROGRAMS) {
+            log_warn("Too many programs in PAT, only first %u are used", MAX_PROGRAMS);
+            break;
+        }
+        if (dec->pid_table[entry.program_pid] != 0) {
+            log_warn("PMT PID %u of program %u is already in use, skipping", entry.program_pid, entry.program_num);
+            continue;
+        }
+
+        program_t *program = &dec->programs[dec->program_count];
+        program->program_num = entry.program_num;
+        program->pmt_pid = entry.program_pid;
+        program->section.length = 0;
+        program->section.version = 0xff;
+        dec->pid_table[entry.program_pid] = PID_TABLE_PMT + dec->program_count;
+        pid_filter_set(dec, entry.program_pid);
+        dec->program_count++;
+    }
+}
+
+// teletext_descriptor or VBI_teletext_descriptor (ETSI EN 300 468) present?
+static uint8_t has_teletext_descriptor(const uint8_t *descriptors, uint16_t length) {
+    for (uint16_t i = 0; i + 2 <= length; i += 2 + descriptors[i + 1]) {
+        if ((descriptors[i] == 0x56) || (descriptors[i] == 0x46))
+            return YES;
+    }
+    return NO;
+}
+
+// is teletext PID pid decoded by us? the first one announced is taken by subscriptions waiting for PMT
+static uint8_t claim_teletext_pid(telx_decoder_t *dec, uint16_t pid, uint16_t program_num) {
+    uint8_t index = dec->pid_table[pid];
+    if (index > MAX_SUBSCRIPTIONS)
+        return NO;
+
+    pid_stream_t *waiting = NULL;
+    uint8_t w = 0;
+    for (uint8_t i = 0; i < dec->stream_count; i++) {
+        if (dec->streams[i]->pid == PID_ANY) {
+            waiting = dec->streams[i];
+            w = i;
+        }
+    }
+    if (waiting == NULL)
+        return (index > 0) ? YES : NO;
+
+    log_info("Using teletext PID %u of program %u", pid, program_num);
+    if (index == 0) {
+        waiting->pid = pid;
+        dec->pid_table[pid] = w + 1;
+        pid_filter_set(dec, pid);
+        return YES;
+    }
+
+    // PID is subscribed already, waiting pages join its stream
+    pid_stream_t *stream = dec->streams[index - 1];
+    for (uint8_t j = 0; j < waiting->page_count; j++) {
+        if (stream->page_count == MAX_PAGES_PER_PID) {
+            log_warn("Too many pages in PID %u, page %03x dropped", pid, waiting->pages[j]->page);
+            free(waiting->pages[j]);
+            dec->page_count--;
+            continue;
+        }
+        stream->pages[stream->page_count++] = waiting->pages[j];
+    }
+    if ((waiting->cache != NULL) && (stream->cache == NULL)) {
+        stream->cache = waiting->cache;
+    } else if (waiting->cache != NULL) {
+        log_warn("PID %u is captured already, second capture dropped", pid);
+        free_cache(waiting->cache);
+    }
+    free(waiting);
+
+    // last stream takes the free slot
+    dec->stream_count--;
+    if (w != dec->stream_count) {
+        dec->streams[w] = dec->streams[dec->stream_count];
+        if (dec->streams[w]->pid != PID_ANY)
+            dec->pid_table[dec->streams[w]->pid] = w + 1;
+    }
+    return YES;
+}
+
+static void process_pmt(telx_decoder_t *dec, program_t *program, const uint8_t *section) {
+    pmt_t pmt = { 0 };
+    pmt.table_id = section[0];
+    pmt.section_length = ((section[1] & 0x0f) << 8) | section[2];
+    pmt.program_num = (section[3] << 8) | section[4];
+    pmt.current_next_indicator = section[5] & 0x01;
+    pmt.pcr_pid = ((section[8] & 0x1f) << 8) | section[9];
+    pmt.program_info_length = ((section[10] & 0x0f) << 8) | section[11];
+    if ((pmt.table_id != 0x02) || (pmt.program_num != program->program_num))
+        return;
+
+    // elementary stream loop, CRC_32 excluded
+    uint8_t teletext = NO;
+    uint16_t end = 3 + pmt.section_length - 4;
+    for (uint16_t i = 12 + pmt.program_info_length; i + 5 <= end; ) {
+        pmt_program_descriptor_t es = { 0 };
+        es.stream_type = section[i];
+        es.elementary_pid = ((section[i + 1] & 0x1f) << 8) | section[i + 2];
+        es.es_info_length = ((section[i + 3] & 0x0f) << 8) | section[i + 4];
+        i += 5;
+        if (i + es.es_info_length > end)
+            break;
+
+        // teletext is carried in PES packets of private data
+        if ((es.stream_type == 0x06) && (has_teletext_descriptor(&section[i], es.es_info_length) == YES) &&
+            (claim_teletext_pid(dec, es.elementary_pid, pmt.program_num) == YES))
+            teletext = YES;
+        i += es.es_info_length;
+    }
+    if (teletext == NO)
+        return;
+
+    if ((dec->program_num != 0) && (dec->program_num != pmt.program_num)) {
+        log_warn("Teletext PIDs of more than one program subscribed, using PCR of program %u", dec->program_num);
+        return;
+    }
+    dec->program_num = pmt.program_num;
+
+    // PCR_PID 0x1fff: program without PCR, the PCR in use so far (or of any PID) is kept
+    if ((dec->pcr_pid_fixed == NO) && (pmt.pcr_pid != PID_NULL) && (dec->pcr_pid != pmt.pcr_pid)) {
+        dec->pcr_pid = pmt.pcr_pid;
+        log_info("Using PCR of PID %u (program %u)", pmt.pcr_pid, pmt.program_num);
+    }
+}
 
-    // skip optional PES header and process each 46 bytes long teletext packet
-    uint16_t i = 7;
-    if (optional_pes_header_included == YES) i += 3 + optional_pes_header_length;
-    while (i <= pes_packet_length - 6) {
-        uint8_t data_unit_id = buffer[i++];
-        uint8_t data_unit_len = buffer[i++];
+// complete section; program is NULL for PAT
+static void process_psi_section(telx_decoder_t *dec, psi_section_buffer_t *psi, program_t *program) {
+    uint8_t *section = psi->buffer;
 
-        if ((data_unit_id == DATA_UNIT_EBU_TELETEXT_NONSUBTITLE) || (data_unit_id == DATA_UNIT_EBU_TELETEXT_SUBTITLE)) {
-            // teletext payload has always size 44 bytes
-            if (data_unit_len == 44) {
-                // reverse endianess (via lookup table), ETS 300 706, chapter 7.1
-                for (uint8_t j = 0; j < data_unit_len; j++) buffer[i + j] = REVERSE_8[buffer[i + j]];
+    // long form sections only, current ones only, and only section 0 (PAT/PMT of up to 1024 bytes)
+    if (((section[1] & 0x80) == 0) || ((section[5] & 0x01) == 0) || (section[6] != 0))
+        return;
 
-                // FIXME: This explicit type conversion could be a problem some day -- do not need to be platform independant
-                process_telx_packet(data_unit_id, (teletext_packet_payload_t *)&buffer[i], last_timestamp);
+    // nothing changed since the last version
+    uint8_t version = (section[5] >> 1) & 0x1f;
+    if (version == psi->version)
+        return;
+
+    if (psi_crc32(section, psi->length) != 0) {
+        log_warn("PSI section CRC error, skipping");
+        return;
+    }
+    psi->version = version;
+
+    if (program == NULL)
+        process_pat(dec, section);
+    else
+        process_pmt(dec, program, section);
+}
+
+// appends section data; a packet can complete one section and start next one
+static void append_psi_data(telx_decoder_t *dec, psi_section_buffer_t *psi, program_t *program, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        // stuffing up to the end of packet
+        if ((psi->length == 0) && (data[0] == 0xff))
+            return;
+
+        uint16_t needed = 3;
+        if (psi->length >= 3) {
+            uint16_t section_length = ((psi->buffer[1] & 0x0f) << 8) | psi->buffer[2];
+            // shortest long form section: 5 bytes header + CRC_32
+            if ((section_length < 9) || (section_length > PSI_SECTION_SIZE - 3)) {
+                psi->length = 0;
+                return;
             }
+            needed += section_length;
         }
 
-        i += data_unit_len;
+        size_t n = needed - psi->length;
+        if (n > size) n = size;
+        memcpy(&psi->buffer[psi->length], data, n);
+        psi->length += n;
+        data += n;
+        size -= n;
+
+        if ((psi->length > 3) && (psi->length == needed)) {
+            process_psi_section(dec, psi, program);
+            psi->length = 0;
+        }
     }
 }
 
-void process_ts_packet(uint8_t *ts_packet) {
+static void process_psi_packet(telx_decoder_t *dec, psi_section_buffer_t *psi, program_t *program, uint8_t *ts_packet) {
+    uint8_t *payload = ts_payload(ts_packet);
+    uint8_t *end = ts_packet + TS_SIZE;
+    if (payload >= end)
+        return;
+
+    // section in progress is lost with a missing packet
+    uint8_t continuity_counter = ts_get_cc(ts_packet);
+    if ((psi->length > 0) && (continuity_counter != ((psi->continuity_counter + 1) & 0x0f)))
+        psi->length = 0;
+    psi->continuity_counter = continuity_counter;
+
+    if (!ts_get_unitstart(ts_packet)) {
+        if (psi->length > 0)
+            append_psi_data(dec, psi, program, payload, end - payload);
+        return;
+    }
+
+    // pointer_field: bytes finishing previous section precede the new one
+    uint8_t pointer_field = *payload++;
+    if ((size_t) pointer_field > (size_t) (end - payload)) {
+        psi->length = 0;
+        return;
+    }
+    if (psi->length > 0)
+        append_psi_data(dec, psi, program, payload, pointer_field);
+    psi->length = 0;
+    payload += pointer_field;
+    append_psi_data(dec, psi, program, payload, end - payload);
+}
+
+// full decode of a TS packet that passed the PID pre-filter
+static void process_ts_packet(telx_decoder_t *dec, uint8_t *ts_packet) {
     if (!ts_validate(ts_packet)) {
         log_warn("Invalid TS packet received. Skipping");
         return;
@@ -691,128 +1351,264 @@ void process_ts_packet(uint8_t *ts_packet) {
     }
 
     // if available, calculate current PCR
-    if (header.adaptation_field_exists > 0) {
+    if ((header.adaptation_field_exists > 0) && (ts_packet[4] > 0) && ((dec->pcr_pid == PID_ANY) || (dec->pcr_pid == header.pid))) {
         // PCR in adaptation field
         uint8_t af_pcr_exists = (ts_packet[5] & 0x10) >> 4;
         if (af_pcr_exists > 0) {
-            uint64_t pts = ts_packet[6];
-            pts <<= 25;
-            pts |= (ts_packet[7] << 17);
-            pts |= (ts_packet[8] << 9);
-            pts |= (ts_packet[9] << 1);
-            pts |= (ts_packet[10] >> 7);
-            global_timestamp = pts / 90;
-            pts = ((ts_packet[10] & 0x01) << 8);
-            pts |= ts_packet[11];
-            global_timestamp += pts / 27000;
+            update_pcr(dec, ts_packet);
         }
     }
 
-    // null packet
-    if (header.pid == 0x1fff)
+    // PID lookup: every subscribed PID has its own PES assembler
+    uint8_t index = dec->pid_table[header.pid];
+    if (index == 0)
         return;
-
-    if (config.tid == header.pid) {
-        // TS continuity check
-        if (continuity_counter == 255) {
-            continuity_counter = header.continuity_counter;
-        } else {
-            if (af_discontinuity == 0) {
-                continuity_counter = (continuity_counter + 1) % 16;
-                if (header.continuity_counter != continuity_counter) {
-                    log_warn("Missing TS packet, flushing pes_buffer (expected CC %1x, received CC %1x, TS discontinuity %s, TS priority %s)",
-                        continuity_counter, header.continuity_counter, (af_discontinuity ? "YES" : "NO"), (header.transport_priority ? "YES" : "NO"));
-                    payload_counter = 0;
-                    continuity_counter = 255;
-                }
+    if (index == PID_TABLE_PAT) {
+        process_psi_packet(dec, &dec->pat_section, NULL, ts_packet);
+        return;
+    }
+    if (index >= PID_TABLE_PMT) {
+        program_t *program = &dec->programs[index - PID_TABLE_PMT];
+        process_psi_packet(dec, &program->section, program, ts_packet);
+        return;
+    }
+    pid_stream_t *stream = dec->streams[index - 1];
+
+    // TS continuity check
+    if (stream->continuity_counter == 255) {
+        stream->continuity_counter = header.continuity_counter;
+    } else {
+        if (af_discontinuity == 0) {
+            stream->continuity_counter = (stream->continuity_counter + 1) % 16;
+            if (header.continuity_counter != stream->continuity_counter) {
+                log_warn("Missing TS packet, dropping rest of PES packet (expected CC %1x, received CC %1x, TS discontinuity %s, TS priority %s)",
+                    stream->continuity_counter, header.continuity_counter, (af_discontinuity ? "YES" : "NO"), (header.transport_priority ? "YES" : "NO"));
+                stream->pes_state = PES_IDLE;
+                stream->continuity_counter = 255;
             }
         }
+    }
 
-        // waiting for first payload_unit_start indicator
-        if ((header.payload_unit_start == 0) && (payload_counter == 0))
-            return;
+    // adaptation field is skipped; it may fill the whole packet, or claim more than that if corrupted
+    uint8_t *payload = ts_payload(ts_packet);
+    if (payload >= ts_packet + TS_SIZE)
+        return;
 
-        // proceed with payload buffer
-        if ((header.payload_unit_start > 0) && (payload_counter > 0))
-            process_pes_packet(payload_buffer, payload_counter);
+    process_pes_payload(dec, stream, payload, ts_packet + TS_SIZE - payload, header.payload_unit_start);
+}
 
-        // new payload frame start
-        if (header.payload_unit_start > 0)
-            payload_counter = 0;
+// PID pre-filter: the bulk of a mux (video, audio, other PIDs) is discarded here, looking at
+// nothing but the 13 bits PID and, for the PCR PID, the adaptation field flags
+static inline void filter_ts_packet(telx_decoder_t *dec, uint8_t *ts_packet) {
+    uint16_t pid = ((ts_packet[1] & 0x1f) << 8) | ts_packet[2];
 
-        // add payload data to buffer
-        if (payload_counter < (PAYLOAD_BUFFER_SIZE - TS_PACKET_PAYLOAD_SIZE)) {
-            memcpy(&payload_buffer[payload_counter], &ts_packet[4], TS_PACKET_PAYLOAD_SIZE);
-            payload_counter += TS_PACKET_PAYLOAD_SIZE;
-        } else {
-            log_warn("Packet payload size exceeds payload_buffer size, probably not teletext stream");
-        }
+    if ((dec->pid_filter[pid >> 6] & (1ULL << (pid & 0x3f))) != 0) {
+        process_ts_packet(dec, ts_packet);
+        return;
     }
+
+    // PCR carried in other PID (adaptation field present, non-empty, PCR flag set)
+    if (((dec->pcr_pid == pid) || (dec->pcr_pid == PID_ANY)) &&
+        ((ts_packet[3] & 0x20) != 0) && (ts_packet[4] > 0) && ((ts_packet[5] & 0x10) != 0) &&
+        ts_validate(ts_packet) && ((ts_packet[1] & 0x80) == 0))
+        update_pcr(dec, ts_packet);
 }
 
-int main(const int argc, char *argv[]) {
-    uint16_t pid, page;
-    in_addr_t addr;
-    uint32_t port;
-    int s, e;
+void telx_feed_ts(telx_decoder_t *dec, uint8_t *ts_packet) {
+    filter_ts_packet(dec, ts_packet);
+}
 
-    if (argc != 5)
-        errx(1, "usage: teletext-ingest <pid> <page> <addr> <port>");
+void telx_feed_ts_burst(telx_decoder_t *dec, uint8_t *ts_packets, unsigned int count) {
+    for (unsigned int i = 0; i < count; i++)
+        filter_ts_packet(dec, ts_packets + i * TS_SIZE);
+}
 
-    pid = strtoul(argv[1], NULL, 10);
-    page = strtoul(argv[2], NULL, 10);
-    addr = inet_addr(argv[3]);
-    port = strtoul(argv[4], NULL, 10);
+// ETS 300 706, chapter 9.3.1.3: pages flagged as subtitles (C6) in their headers
+static void log_subtitle_pages(telx_decoder_t *dec) {
+    char list[8 * 256 * 4 + 1];
+    size_t length = 0;
+    for (uint8_t m = 1; m <= 8; m++) {
+        for (uint16_t i = 0; i < 256; i++) {
+            if (((dec->cc_map[i] >> (m - 1)) & 0x01) == 0) continue;
+            length += snprintf(&list[length], sizeof(list) - length, " %03x", (m << 8) | i);
+        }
+    }
+    if (length > 0) log_info("Subtitle pages:%s", list);
+}
 
-    // Setup telxcc parser config
-    config.utc_refvalue = (uint64_t) time(NULL);
-    config.tid = pid;
-    // dec to BCD, magazine pages numbers are in BCD (ETSI 300 706)
-    config.page = ((page / 100) << 8) | (((page / 10) % 10) << 4) | (page % 10);
+void telx_flush(telx_decoder_t *dec) {
+    for (uint8_t i = 0; i < dec->stream_count; i++) {
+        pid_stream_t *stream = dec->streams[i];
 
-    // Multicast receiver
-    s = socket(AF_INET, SOCK_DGRAM, PF_UNSPEC);
-    if (s == -1)
-        err(1, "socket");
+        // data units of the last PES packet are processed already, any partial one is dropped
+        stream->pes_state = PES_IDLE;
+        stream->carry_length = 0;
 
-    int yes = 1;
-    e = setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
-    if (e == -1)
-        err(1, "reuseaddr");
+        for (uint8_t j = 0; j < stream->page_count; j++)
+            finish_page(dec, stream, stream->pages[j]);
 
-    struct sockaddr_in sin = { 0 };
-    sin.sin_family = AF_INET;
-    sin.sin_addr.s_addr = htonl(INADDR_ANY);
-    sin.sin_port = htons(port);
+        page_cache_t *cache = stream->cache;
+        if (cache != NULL) {
+            for (uint16_t j = 0; j < cache->count; j++)
+                finish_page(dec, stream, cache->pool[j]);
+            memset(cache->receiving, 0, sizeof(cache->receiving));
+            log_info("PID %u: %u pages cached, %"PRIu64" evicted", stream->pid, cache->count, cache->evicted);
+        }
+    }
 
-    e = bind(s, (struct sockaddr *) &sin, sizeof sin);
-    if (e == -1)
-        err(1, "bind");
+    log_subtitle_pages(dec);
+}
 
-    e = setsockopt(s, IPPROTO_IP, IP_ADD_MEMBERSHIP, (struct ip_mreq[]){{
-            .imr_multiaddr.s_addr = addr,
-            .imr_interface.s_addr = htonl(INADDR_ANY)}}, sizeof(struct ip_mreq));
-    if (e == -1)
-        err(1, "setsockopt");
+void telx_tick(telx_decoder_t *dec, uint64_t now) {
+    for (uint8_t i = 0; i < dec->stream_count; i++) {
+        pid_stream_t *stream = dec->streams[i];
 
-    uint8_t buffer[RTP_HEADER_SIZE + 7 * TS_SIZE] = { 0 };
-    uint8_t *ts_packet = NULL;
+        // stream time stands still while the PID is quiet, the time passed meanwhile is added
+        if (stream->last_timestamp != stream->ticked_timestamp) {
+            stream->ticked_timestamp = stream->last_timestamp;
+            stream->ticked_at = now;
+        }
+        if (dec->pending_cues == 0) continue;
+        uint64_t t = stream->last_timestamp + (now - stream->ticked_at);
+
+        for (uint8_t j = 0; j < stream->page_count; j++)
+            expire_cue(dec, stream->pages[j], t);
+        if (stream->cache != NULL) {
+            for (uint16_t j = 0; j < stream->cache->count; j++)
+                expire_cue(dec, stream->cache->pool[j], t);
+        }
+    }
+}
 
-    // reading input
-    while (1) {
-        if (recv(s, &buffer, sizeof buffer, 0) != sizeof buffer) {
-            log_warn("Read to few packets :-(");
-        } else if (!rtp_check_hdr(&buffer[0])) {
-            log_warn("Invalid RTP packet received. Skipping");
-        } else {
-            ts_packet = rtp_payload(&buffer[0]);
+// stream of PID pid, created if there is none yet; NULL = PID can not carry teletext or out of memory
+static pid_stream_t *subscribe_stream(telx_decoder_t *dec, uint16_t pid) {
+    // PAT and null packets carry no teletext
+    if ((pid == 0) || (pid == PID_NULL) || (pid > PID_ANY))
+        return NULL;
+    if ((pid != PID_ANY) && (dec->pid_table[pid] > MAX_SUBSCRIPTIONS))
+        return NULL;
+
+    // a subscription without PID waits for PMT, sharing one stream with all other such subscriptions
+    pid_stream_t *stream = NULL;
+    if (pid == PID_ANY) {
+        for (uint8_t i = 0; i < dec->stream_count; i++) {
+            if (dec->streams[i]->pid == PID_ANY)
+                stream = dec->streams[i];
+        }
+    } else if (dec->pid_table[pid] > 0) {
+        stream = dec->streams[dec->pid_table[pid] - 1];
+    }
 
-            for (int i = 0; i < 7; i++) {
-                process_ts_packet(ts_packet);
-                ts_packet += TS_SIZE;
-            }
+    if ((stream == NULL) && (dec->stream_count == MAX_SUBSCRIPTIONS))
+        return NULL;
+    if (stream == NULL) {
+        stream = calloc(1, sizeof(pid_stream_t));
+        if (stream == NULL)
+            return NULL;
+        stream->pid = pid;
+        stream->continuity_counter = 255;
+        stream->transmission_mode = TRANSMISSION_MODE_SERIAL;
+        stream->using_pts = UNDEF;
+        stream->pts_initialized = NO;
+        dec->streams[dec->stream_count++] = stream;
+        if (pid != PID_ANY) {
+            dec->pid_table[pid] = dec->stream_count;
+            pid_filter_set(dec, pid);
         }
     }
+    return stream;
+}
+
+int telx_subscribe(telx_decoder_t *dec, uint16_t pid, uint16_t page, const char *tag) {
+    if ((dec->page_count == MAX_SUBSCRIPTIONS) || ((tag != NULL) && (strlen(tag) >= MAX_TAG_LENGTH)))
+        return -1;
+
+    pid_stream_t *stream = subscribe_stream(dec, pid);
+    if ((stream == NULL) || (stream->page_count == MAX_PAGES_PER_PID))
+        return -1;
+
+    page_decoder_t *decoder = calloc(1, sizeof(page_decoder_t));
+    if (decoder == NULL)
+        return -1;
+    init_page_decoder(decoder, page, tag);
+    stream->pages[stream->page_count++] = decoder;
+    dec->page_count++;
+
+    return 0;
+}
+
+int telx_capture(telx_decoder_t *dec, uint16_t pid, uint16_t capacity, const char *tag) {
+    if ((capacity == 0) || ((tag != NULL) && (strlen(tag) >= MAX_TAG_LENGTH)))
+        return -1;
+
+    pid_stream_t *stream = subscribe_stream(dec, pid);
+    if ((stream == NULL) || (stream->cache != NULL))
+        return -1;
+
+    page_cache_t *cache = calloc(1, sizeof(page_cache_t));
+    if (cache == NULL)
+        return -1;
+    cache->pool = calloc(capacity, sizeof(page_decoder_t *));
+    if (cache->pool == NULL) {
+        free(cache);
+        return -1;
+    }
+    cache->capacity = capacity;
+    cache->tag = tag;
+    memset(cache->g0_m29, UNDEF, sizeof(cache->g0_m29));
+    stream->cache = cache;
 
     return 0;
 }
+
+// default output callback
+static void output_stdout(void *opaque, const char *data, size_t length) {
+    fwrite(data, 1, length, stdout);
+    fflush(stdout);
+}
+
+telx_decoder_t *telx_new(uint64_t utc_refvalue, telx_output_cb_t output, void *opaque) {
+    telx_decoder_t *dec = calloc(1, sizeof(telx_decoder_t));
+    if (dec == NULL)
+        return NULL;
+
+    dec->utc_refvalue = utc_refvalue;
+    dec->programme_info_processed = NO;
+    dec->pcr_pid = PID_ANY;
+    dec->pcr_pid_fixed = NO;
+    // PAT is always followed, PMTs tell teletext PIDs and PCR PID
+    dec->pat_section.version = 0xff;
+    dec->pid_table[0] = PID_TABLE_PAT;
+    pid_filter_set(dec, 0);
+    telx_set_output(dec, output, opaque);
+
+    return dec;
+}
+
+void telx_set_output(telx_decoder_t *dec, telx_output_cb_t output, void *opaque) {
+    dec->output = (output != NULL) ? output : output_stdout;
+    dec->opaque = opaque;
+}
+
+void telx_set_store(telx_decoder_t *dec, page_store_t *store) {
+    dec->store = store;
+}
+
+void telx_set_pcr_pid(telx_decoder_t *dec, uint16_t pid) {
+    dec->pcr_pid = (pid < PID_NULL) ? pid : PID_ANY;
+    dec->pcr_pid_fixed = (dec->pcr_pid != PID_ANY) ? YES : NO;
+}
+
+void telx_free(telx_decoder_t *dec) {
+    if (dec == NULL)
+        return;
+
+    for (uint8_t i = 0; i < dec->stream_count; i++) {
+        for (uint8_t j = 0; j < dec->streams[i]->page_count; j++)
+            free(dec->streams[i]->pages[j]);
+        if (dec->streams[i]->cache != NULL)
+            free_cache(dec->streams[i]->cache);
+        free(dec->streams[i]);
+    }
+    free(dec);
+}
@@ -1,6 +1,11 @@
 #ifndef TELXCC_H_INCLUDED
 #define TELXCC_H_INCLUDED
 
+#include <stdio.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include "store.h"
+
 typedef enum {
     NO = 0x00,
     YES = 0x01,
@@ -75,9 +80,225 @@ typedef struct {
     uint64_t show_timestamp; // show at timestamp (in ms)
     uint64_t hide_timestamp; // hide at timestamp (in ms)
     uint16_t text[25][40]; // 25 lines x 40 cols (1 screen/page) of wide chars
+    uint32_t rows; // bitmap of rows written since the page header; other rows are empty, whatever text holds
+    // column bitmaps of every row, kept up to date as cells are written
+    uint64_t printable[25]; // characters above space
+    uint64_t start_box[25];
+    uint64_t end_box[25];
     uint8_t tainted; // 1 = text variable contains any data
 } teletext_page_t;
 
+// maximum size of a PAT or PMT section (ISO/IEC 13818-1, 2.4.4.3)
+#define PSI_SECTION_SIZE 1024
+
+// maximum number of programs in PAT that are tracked
+#define MAX_PROGRAMS 32
+
+// PSI section assembler
+typedef struct {
+    uint8_t buffer[PSI_SECTION_SIZE];
+    uint16_t length; // 0 = waiting for section start
+    uint8_t continuity_counter;
+    uint8_t version; // version of the last processed section, 0xff = none yet
+} psi_section_buffer_t;
+
+// program announced in PAT
+typedef struct {
+    uint16_t program_num;
+    uint16_t pmt_pid;
+    psi_section_buffer_t section;
+} program_t;
+
+// longest PES header, up to and including data_identifier: 9 bytes fixed part, 255 bytes optional fields
+#define PES_HEADER_MAX_SIZE (9 + 255 + 1)
+
+typedef enum {
+    PES_IDLE = 0, // waiting for payload_unit_start
+    PES_HEADER,
+    PES_DATA_UNITS
+} pes_state_t;
+
+// maximum length of an output line prefix
+#define MAX_TAG_LENGTH 256
+
+// maximum number of pages subscribed on a single PID
+#define MAX_PAGES_PER_PID 16
+
+// size of the buffer a page is rendered into before it is handed over to the output callback
+#define OUTPUT_BUFFER_SIZE 32768
+
+// longest time a page is held back for retransmissions to extend it (in ms); a page shown longer is output
+// in parts of about this length, so that live output lags at most this much behind
+#define MAX_CUE_HOLD 1000
+
+// <font> opening tag length
+#define FONT_TAG_LENGTH (sizeof("<font color=\"#000000\">") - 1)
+
+// largest rendered row: every column closes a tag, opens another one and holds the longest entity
+#define MAX_ROW_OUTPUT (40 * (sizeof("</font> ") - 1 + FONT_TAG_LENGTH + sizeof("&amp;") - 1) + sizeof("</font>\t"))
+
+// current charset (charset can be -- and always is -- changed during transmission)
+typedef struct {
+    uint8_t current;
+    uint8_t g0_m29;
+    uint8_t g0_x28;
+    const uint16_t *g0; // G0_LATIN_SUBSETS entry of current, shared read-only by all decoders
+    const uint16_t *reverse_parity_g0; // REVERSE_PARITY_G0_LATIN entry of current
+    uint64_t announced[2]; // bitmap of the subset IDs (7 bits) logged already
+} primary_charset_t;
+
+// decoder state of a single subscribed teletext page
+typedef struct page_decoder {
+    uint16_t page; // teletext page number (BCD)
+    uint16_t subpage; // subcode of the page being received, see store_page_t
+    const char *tag; // output line prefix, NULL = no prefix
+    size_t tag_length;
+    uint8_t boxed; // YES = boxed areas are output only (subtitles, newsflashes), NO = whole rows
+    teletext_page_t page_buffer; // working teletext page buffer
+    uint8_t receiving_data; // flag indicating if incoming data should be processed or ignored
+    primary_charset_t primary_charset;
+    // rows as rendered last time; a row is rendered again only if its cells have changed
+    uint16_t rendered_text[25][40];
+    uint32_t rendered_rows; // bitmap of rows of rendered_text that may be non-empty
+    uint32_t boxed_rows; // bitmap of rows of rendered_text holding a start box, or any text if the page is not boxed
+    uint64_t row_hash[25];
+    uint16_t row_length[25]; // 0 = nothing to output
+    // last page is held back until a different one arrives, so that retransmissions only extend its hide timestamp;
+    // held back for MAX_CUE_HOLD at most
+    uint8_t cue_pending;
+    uint64_t cue_hash;
+    uint64_t cue_show_timestamp;
+    uint64_t cue_hide_timestamp;
+    size_t cue_length;
+    // pages of a page_cache_t only
+    uint8_t subtitle; // YES = page has been flagged as subtitle, it is never evicted
+    struct page_decoder *lru_prev;
+    struct page_decoder *lru_next;
+    char tag_buffer[MAX_TAG_LENGTH + sizeof("\t888")];
+    // output buffers go last, a reused decoder is cleared up to them (their lengths are zero then)
+    char row_output[25][MAX_ROW_OUTPUT];
+    char cue[OUTPUT_BUFFER_SIZE];
+} page_decoder_t;
+
+// number of pages of a whole service decoded at once, unless told otherwise; a page decoder takes about 72 KiB,
+// so a full cache about 18 MiB
+#define CACHE_PAGES 256
+
+// decoders of every page of a teletext service, see telx_capture()
+typedef struct {
+    page_decoder_t **pool; // capacity decoders, each one allocated once a page first needs it
+    uint16_t capacity;
+    uint16_t count; // pool entries allocated so far
+    uint16_t index[8 * 256]; // (magazine & 7) << 8 | page -> pool entry + 1, 0 = page is not cached
+    page_decoder_t *receiving[8]; // page being received in every magazine, NULL = none
+    // pages that can be evicted, least recently received first; subtitle pages are not listed
+    page_decoder_t *lru_head;
+    page_decoder_t *lru_tail;
+    uint8_t g0_m29[8]; // M/29 charset of every magazine, applied to newly cached pages
+    const char *tag; // output line prefix, NULL = no prefix
+    uint64_t evicted;
+    uint64_t dropped; // headers of pages not cached, as all cached pages were subtitles
+} page_cache_t;
+
+// PES assembler state of a single teletext PID, shared by all pages carried in it
+typedef struct {
+    uint16_t pid;
+    uint8_t continuity_counter; // 0xff means not set yet
+    // data units are parsed right from the TS packet payloads; only a PES header or a data unit split
+    // across TS packets is gathered in carry
+    pes_state_t pes_state;
+    uint32_t pes_remaining; // bytes of the PES packet not received yet
+    uint16_t carry_length;
+    uint8_t carry[PES_HEADER_MAX_SIZE];
+    transmission_mode_t transmission_mode;
+    uint8_t using_pts; // should we use PTS or PCR?
+    uint8_t pts_initialized;
+    int64_t delta;
+    uint32_t t0;
+    uint64_t last_timestamp; // last timestamp computed
+    uint64_t ticked_timestamp; // last_timestamp at the latest telx_tick()
+    uint64_t ticked_at; // telx_tick() time last_timestamp was seen to change at
+    page_decoder_t *pages[MAX_PAGES_PER_PID];
+    uint8_t page_count;
+    page_cache_t *cache; // whole service, NULL = subscribed pages only
+} pid_stream_t;
+
+// maximum number of (pid, page) subscriptions per decoder
+#define MAX_SUBSCRIPTIONS 64
+
+// number of possible TS PIDs
+#define PID_COUNT 8192
+
+// null packets PID
+#define PID_NULL 0x1fff
+
+// pcr_pid value: PCR is taken from any PID carrying one; subscription PID: teletext PID is taken from PMT
+#define PID_ANY PID_COUNT
+
+// pid_table values above MAX_SUBSCRIPTIONS: PID carries PAT, or PMT of programs[value - PID_TABLE_PMT]
+#define PID_TABLE_PAT 0xff
+#define PID_TABLE_PMT 0x80
+
+// receives every rendered page, one line terminated by '\n'
+typedef void (*telx_output_cb_t)(void *opaque, const char *data, size_t length);
+
+// decoder instance; every piece of decoding state lives here, so any number of instances
+// can run in one process, each one driven by a single thread at a time
+typedef struct {
+    uint64_t utc_refvalue; // UTC referential value
+    uint8_t programme_info_processed; // flag for notices that should be printed only once
+    uint8_t cc_map[256]; // subtitle type pages bitmap, 2048 bits = 2048 possible pages in teletext (excl. subpages)
+    uint32_t global_timestamp; // TS PCR value
+    uint16_t pcr_pid; // PID the PCR is taken from, PID_ANY = any PID (until found in PMT)
+    uint8_t pcr_pid_fixed; // pcr_pid set by user, PMT does not override it
+    uint16_t program_num; // program carrying the subscribed teletext PIDs, 0 = not known yet
+    psi_section_buffer_t pat_section;
+    program_t programs[MAX_PROGRAMS];
+    uint8_t program_count;
+    uint64_t pid_filter[PID_COUNT / 64]; // PIDs that need full decoding (subscribed PIDs) as a bitmap
+    uint8_t pid_table[PID_COUNT]; // PID lookup table; index + 1 into streams, 0 = PID not subscribed, PID_TABLE_* = PSI
+    pid_stream_t *streams[MAX_SUBSCRIPTIONS];
+    uint8_t stream_count;
+    uint8_t page_count;
+    telx_output_cb_t output;
+    void *opaque;
+    uint32_t pending_cues; // pages held back by all page decoders
+    char output_buffer[OUTPUT_BUFFER_SIZE];
+    size_t output_length;
+    page_store_t *store; // every received page is recorded here, NULL = none
+} telx_decoder_t;
+
+// utc_refvalue is the initial UTC referential value (unix timestamp), output receives every rendered page
+telx_decoder_t *telx_new(uint64_t utc_refvalue, telx_output_cb_t output, void *opaque);
+void telx_free(telx_decoder_t *dec);
+// replaces the output callback; NULL = stdout
+void telx_set_output(telx_decoder_t *dec, telx_output_cb_t output, void *opaque);
+// registers page (BCD) carried in PID pid, PID_ANY = first teletext PID announced in PMT;
+// tag, if not NULL, prefixes every output line; returns -1 if there is no room left or tag is too long
+int telx_subscribe(telx_decoder_t *dec, uint16_t pid, uint16_t page, const char *tag);
+// decodes every page carried in PID pid (PID_ANY = first teletext PID announced in PMT), up to capacity pages
+// at once; page decoders are allocated as pages are received, pages not received for the longest time, except
+// subtitles, make room for new ones once there are capacity of them;
+// every output line starts with tag (if not NULL) and page number; returns -1 on error
+int telx_capture(telx_decoder_t *dec, uint16_t pid, uint16_t capacity, const char *tag);
+// records every received page of every subscribed or captured page into store, NULL = none;
+// store is used by the thread driving dec only
+void telx_set_store(telx_decoder_t *dec, page_store_t *store);
+// PCR is taken from PID pid only; PID_ANY (default) = PCR_PID of the program found in PMT
+void telx_set_pcr_pid(telx_decoder_t *dec, uint16_t pid);
+// processes one 188 bytes long TS packet
+void telx_feed_ts(telx_decoder_t *dec, uint8_t *ts_packet);
+// processes count consecutive TS packets
+void telx_feed_ts_burst(telx_decoder_t *dec, uint8_t *ts_packets, unsigned int count);
+// end of input: processes buffered PES packets and outputs pages still being received
+void telx_flush(telx_decoder_t *dec);
+// outputs pages held back for MAX_CUE_HOLD (see page_decoder_t) even if their PID has gone quiet; their stream
+// time is advanced by the time passed since it last moved; now is in ms of any monotonic clock, called
+// periodically by the thread driving dec
+void telx_tick(telx_decoder_t *dec, uint64_t now);
+// writes the UTF-8 encoding of UCS-2 character ch to r (at most 3 bytes), returns its length
+size_t telx_utf8(char *r, uint16_t ch);
+
 #define log_warn(...) do { fprintf(stderr, "[WARN] "); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while (0)
 #define log_info(...) do { fprintf(stderr, "[INFO] "); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while (0)
 
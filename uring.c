@@ -0,0 +1,278 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <err.h>
+#include "uring.h"
+#include "pipeline.h"
+#include "rxconf.h"
+
+// a buffer holds the recvmsg header, control messages and the datagram; no source address
+#define URING_BUFFER_SIZE (sizeof(struct io_uring_recvmsg_out) + RXCONF_CONTROL_SIZE + MAX_DATAGRAM_SIZE)
+
+// io_uring instance with its rings mapped, there is no liburing dependency
+typedef struct {
+    int fd;
+    // submission queue
+    uint8_t *sq_ring;
+    size_t sq_ring_size;
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t sq_mask;
+    uint32_t *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned int to_submit;
+    // completion queue, sharing the mapping of the submission queue with IORING_FEAT_SINGLE_MMAP
+    uint8_t *cq_ring;
+    size_t cq_ring_size;
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_cqe *cqes;
+    // provided buffers
+    struct io_uring_buf_ring *buf_ring;
+    uint16_t buf_tail;
+    uint8_t *buffers;
+    struct msghdr msg; // template of every recvmsg
+    struct {
+        uint64_t calls; // io_uring_enter()
+        uint64_t datagrams;
+        uint64_t rearmed; // multishot recvmsg ended, e.g. out of buffers
+        uint64_t nobufs; // out of buffers, datagrams are left to the socket queue
+        time_t reported;
+    } stats;
+    rxconf_stats_t sockets;
+} uring_t;
+
+static void uring_close(uring_t *u) {
+    if (u->buffers != NULL) munmap(u->buffers, (size_t) URING_BUFFERS * URING_BUFFER_SIZE);
+    if (u->buf_ring != NULL) munmap(u->buf_ring, URING_BUFFERS * sizeof(struct io_uring_buf));
+    if (u->sqes != NULL) munmap(u->sqes, u->sqes_size);
+    if ((u->cq_ring != NULL) && (u->cq_ring != u->sq_ring)) munmap(u->cq_ring, u->cq_ring_size);
+    if (u->sq_ring != NULL) munmap(u->sq_ring, u->sq_ring_size);
+    close(u->fd);
+}
+
+// returns NO if the kernel lacks any feature needed
+static uint8_t uring_open(uring_t *u, unsigned int sq_entries) {
+    memset(u, 0, sizeof(uring_t));
+
+    // completions are processed by the submitting thread only, deferred task work is run when it waits
+    struct io_uring_params p = { 0 };
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    p.cq_entries = URING_CQ_ENTRIES;
+    u->fd = syscall(__NR_io_uring_setup, sq_entries, &p);
+    if ((u->fd == -1) && (errno == EINVAL)) {
+        // before Linux 6.1
+        memset(&p, 0, sizeof(p));
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = URING_CQ_ENTRIES;
+        u->fd = syscall(__NR_io_uring_setup, sq_entries, &p);
+    }
+    if (u->fd == -1) {
+        log_warn("io_uring_setup: %s", strerror(errno));
+        return NO;
+    }
+    // timeout of io_uring_enter(), Linux 5.11
+    if ((p.features & IORING_FEAT_EXT_ARG) == 0) {
+        log_warn("io_uring: IORING_FEAT_EXT_ARG not supported");
+        close(u->fd);
+        return NO;
+    }
+
+    u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    u->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cq_ring_size > u->sq_ring_size) u->sq_ring_size = u->cq_ring_size;
+        u->cq_ring_size = u->sq_ring_size;
+    }
+    u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (u->sq_ring == MAP_FAILED)
+        err(1, "mmap(IORING_OFF_SQ_RING)");
+    u->cq_ring = u->sq_ring;
+    if ((p.features & IORING_FEAT_SINGLE_MMAP) == 0) {
+        u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+        if (u->cq_ring == MAP_FAILED)
+            err(1, "mmap(IORING_OFF_CQ_RING)");
+    }
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED)
+        err(1, "mmap(IORING_OFF_SQES)");
+
+    u->sq_head = (uint32_t *) (u->sq_ring + p.sq_off.head);
+    u->sq_tail = (uint32_t *) (u->sq_ring + p.sq_off.tail);
+    u->sq_mask = *(uint32_t *) (u->sq_ring + p.sq_off.ring_mask);
+    u->sq_array = (uint32_t *) (u->sq_ring + p.sq_off.array);
+    u->cq_head = (uint32_t *) (u->cq_ring + p.cq_off.head);
+    u->cq_tail = (uint32_t *) (u->cq_ring + p.cq_off.tail);
+    u->cq_mask = *(uint32_t *) (u->cq_ring + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *) (u->cq_ring + p.cq_off.cqes);
+
+    // provided buffer ring, Linux 5.19
+    u->buf_ring = mmap(NULL, URING_BUFFERS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    u->buffers = mmap(NULL, (size_t) URING_BUFFERS * URING_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if ((u->buf_ring == MAP_FAILED) || (u->buffers == MAP_FAILED))
+        err(1, "mmap");
+    struct io_uring_buf_reg reg = { .ring_addr = (uintptr_t) u->buf_ring, .ring_entries = URING_BUFFERS, .bgid = URING_BUFFER_GROUP };
+    if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+        log_warn("IORING_REGISTER_PBUF_RING: %s", strerror(errno));
+        uring_close(u);
+        return NO;
+    }
+
+    u->msg.msg_controllen = RXCONF_CONTROL_SIZE;
+    u->stats.reported = time(NULL);
+    return YES;
+}
+
+// buffer bid is handed (back) to the kernel, visible once the tail is published
+static void provide_buffer(uring_t *u, uint16_t bid) {
+    struct io_uring_buf *buf = &u->buf_ring->bufs[u->buf_tail & (URING_BUFFERS - 1)];
+    buf->addr = (uintptr_t) (u->buffers + (size_t) bid * URING_BUFFER_SIZE);
+    buf->len = URING_BUFFER_SIZE;
+    buf->bid = bid;
+    u->buf_tail++;
+}
+
+static void publish_buffers(uring_t *u) {
+    __atomic_store_n(&u->buf_ring->tail, u->buf_tail, __ATOMIC_RELEASE);
+}
+
+// multishot recvmsg on the socket of source index; it posts a completion for every datagram until it ends
+static void arm(uring_t *u, const source_t *sources, int index) {
+    uint32_t tail = *u->sq_tail;
+    uint32_t i = tail & u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[i];
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = sources[index].socket;
+    sqe->addr = (uintptr_t) &u->msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = index;
+    u->sq_array[i] = i;
+
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    u->to_submit++;
+}
+
+// completions posted so far; returns NO if multishot recvmsg is not supported (before Linux 6.0)
+static uint8_t reap(uring_t *u, source_t *sources) {
+    uint32_t head = *u->cq_head;
+    uint32_t tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    uint64_t now = monotonic_ns();
+
+    for (; head != tail; head++) {
+        const struct io_uring_cqe *cqe = &u->cqes[head & u->cq_mask];
+        source_t *source = &sources[cqe->user_data];
+
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+            uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            uint8_t *buffer = u->buffers + (size_t) bid * URING_BUFFER_SIZE;
+            const struct io_uring_recvmsg_out *out = (const struct io_uring_recvmsg_out *) buffer;
+            size_t offset = sizeof(struct io_uring_recvmsg_out) + RXCONF_CONTROL_SIZE;
+            if (cqe->res >= (int) offset) {
+                // control messages as much as the kernel wrote of them, the datagram follows the space reserved
+                struct msghdr control = { .msg_control = buffer + sizeof(struct io_uring_recvmsg_out), .msg_controllen = out->controllen };
+                rxconf_control(&control, source, &u->sockets);
+
+                uint8_t *datagram = buffer + offset;
+                // longer datagrams are truncated
+                size_t size = out->payloadlen;
+                if (size > cqe->res - offset) size = cqe->res - offset;
+
+                if (source->channel->worker != NULL)
+                    pipeline_queue(source->channel, datagram, size, source->fec);
+                else
+                    process_channel_datagram(source->channel, datagram, size, source->fec, now);
+                u->stats.datagrams++;
+            }
+            provide_buffer(u, bid);
+        }
+
+        if (cqe->res == -ENOBUFS) {
+            u->stats.nobufs++;
+        } else if ((cqe->res == -EINVAL) && (u->stats.datagrams == 0)) {
+            log_warn("io_uring: multishot recvmsg not supported");
+            return NO;
+        } else if (cqe->res < 0) {
+            log_warn("%s: io_uring recvmsg: %s", source->channel->name, strerror(-cqe->res));
+        }
+
+        // multishot ended, buffers returned above let it continue
+        if ((cqe->flags & IORING_CQE_F_MORE) == 0) {
+            arm(u, sources, cqe->user_data);
+            u->stats.rearmed++;
+        }
+    }
+
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+    publish_buffers(u);
+    return YES;
+}
+
+uint8_t uring_receive(source_t *sources, int source_count, output_t *output) {
+    uring_t u;
+    if (uring_open(&u, source_count) == NO)
+        return NO;
+
+    for (uint16_t bid = 0; bid < URING_BUFFERS; bid++)
+        provide_buffer(&u, bid);
+    publish_buffers(&u);
+    for (int i = 0; i < source_count; i++)
+        arm(&u, sources, i);
+
+    // channels decoded by this thread
+    expiry_t expiry = { 0 };
+    for (int i = 0; i < source_count; i++)
+        if ((sources[i].fec == NO) && (sources[i].channel->worker == NULL)) expiry_add(&expiry, sources[i].channel);
+
+    log_info("Receiving %d sockets through io_uring, %u buffers", source_count, URING_BUFFERS);
+
+    while (1) {
+        // wake up in time for the output deadline and for datagrams held too long
+        int timeout = (output != NULL) ? output_timeout(output) : -1;
+        timeout = expiry_timeout(&expiry, timeout);
+        struct __kernel_timespec ts = { .tv_sec = timeout / 1000, .tv_nsec = (timeout % 1000) * 1000000LL };
+        struct io_uring_getevents_arg arg = { .ts = (timeout >= 0) ? (uintptr_t) &ts : 0 };
+
+        // submits re-armed recvmsg and waits for at least one completion
+        int n = syscall(__NR_io_uring_enter, u.fd, u.to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        if (n == -1) {
+            if ((errno != EINTR) && (errno != ETIME) && (errno != EBUSY))
+                err(1, "io_uring_enter");
+        } else {
+            u.to_submit -= n;
+        }
+        u.stats.calls++;
+
+        if (reap(&u, sources) == NO) {
+            uring_close(&u);
+            return NO;
+        }
+
+        if (output != NULL)
+            output_poll(output);
+
+        time_t now = time(NULL);
+        if (now - u.stats.reported >= URING_STATS_INTERVAL) {
+            log_info("io_uring: %"PRIu64" calls, %"PRIu64" datagrams, average %.2f per call, %"PRIu64" re-armed, %"PRIu64" out of buffers",
+                u.stats.calls, u.stats.datagrams, (double) u.stats.datagrams / u.stats.calls, u.stats.rearmed, u.stats.nobufs);
+            rxconf_log("io_uring", &u.sockets);
+            u.stats.reported = now;
+        }
+    }
+}
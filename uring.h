@@ -0,0 +1,24 @@
+#ifndef URING_H_INCLUDED
+#define URING_H_INCLUDED
+
+#include "ingest.h"
+#include "output.h"
+
+// provided buffers shared by every socket, a power of two; a buffer takes one datagram
+#define URING_BUFFERS 4096
+// completion queue entries, a power of two larger than URING_BUFFERS, so that it never overflows
+#define URING_CQ_ENTRIES 8192
+// buffer group of the provided buffer ring
+#define URING_BUFFER_GROUP 0
+
+// how often receive statistics are logged (in seconds)
+#define URING_STATS_INTERVAL 60
+
+// receives every source through one io_uring instance: a multishot recvmsg per socket takes datagrams
+// straight into buffers of a provided buffer ring, completions are reaped in batches, a single
+// io_uring_enter() call both waits and re-arms; datagrams are decoded in place or copied into the
+// queue of the channel's worker
+// returns NO if the kernel does not support it, otherwise never returns
+uint8_t uring_receive(source_t *sources, int source_count, output_t *output);
+
+#endif